@@ -0,0 +1,108 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef _CSP_CRYPTO_AEAD_H_
+#define _CSP_CRYPTO_AEAD_H_
+
+/**
+   @file
+   AEAD support.
+
+   Authenticated encryption with ChaCha20-Poly1305 (RFC 8439), in a single pass over the data. Used for packets with the
+   #CSP_FAEAD flag, selected per socket/connection with #CSP_SO_AEADREQ / #CSP_O_AEAD.
+
+   A packet is sent as: ciphertext, nonce (#CSP_AEAD_NONCE_LENGTH) and tag (#CSP_AEAD_TAG_LENGTH).
+
+   AEAD is disabled if csp_init() finds that the loaded libcsp.so doesn't match the connection layout this application was
+   built for (logged as an error). Then sockets and connections requiring AEAD can not be created (NULL is returned),
+   csp_sendto() with #CSP_O_AEAD returns #CSP_ERR_NOTSUP, and received packets with #CSP_FAEAD are dropped.
+*/
+
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** AEAD key size in bytes */
+#define CSP_AEAD_KEY_LENGTH	32
+
+/** Nonce bytes appended to the packet, the 12 byte ChaCha20 nonce is 4 zero bytes followed by these */
+#define CSP_AEAD_NONCE_LENGTH	8
+
+/** Authentication tag bytes appended to the packet */
+#define CSP_AEAD_TAG_LENGTH	16
+
+/** Total number of bytes added to a packet */
+#define CSP_AEAD_LENGTH		(CSP_AEAD_NONCE_LENGTH + CSP_AEAD_TAG_LENGTH)
+
+/**
+   Set AEAD key
+   @param[in] key AEAD key, the 32 byte ChaCha20 key is derived from it with SHA1.
+   @param[in] keylen length of key
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_aead_set_key(const void * key, uint32_t keylen);
+
+/**
+   Encrypt and authenticate byte array
+   @param[in,out] data data to be encrypted (in place).
+   @param[in] len length of \a data.
+   @param[in] aad additional data, authenticated but not encrypted (may be NULL if \a aadlen is 0).
+   @param[in] aadlen length of \a aad.
+   @param[in] nonce 12 byte nonce, must never be reused with the same key.
+   @param[out] tag #CSP_AEAD_TAG_LENGTH bytes authentication tag.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_aead_encrypt(void * data, uint32_t len, const void * aad, uint32_t aadlen, const uint8_t nonce[12], uint8_t * tag);
+
+/**
+   Verify and decrypt byte array
+   @param[in,out] data data to be decrypted (in place). Unchanged if verification fails.
+   @param[in] len length of \a data.
+   @param[in] aad additional data (may be NULL if \a aadlen is 0).
+   @param[in] aadlen length of \a aad.
+   @param[in] nonce 12 byte nonce.
+   @param[in] tag #CSP_AEAD_TAG_LENGTH bytes authentication tag.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_AEAD if the tag doesn't match.
+*/
+int csp_aead_decrypt(void * data, uint32_t len, const void * aad, uint32_t aadlen, const uint8_t nonce[12], const uint8_t * tag);
+
+/**
+   Encrypt and authenticate packet, and append nonce and tag.
+   @param packet CSP packet, must be valid.
+   @param include_header authenticate the header (this will not modify the flags field)
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_aead_encrypt_packet(csp_packet_t * packet, bool include_header);
+
+/**
+   Verify and decrypt packet, and strip nonce and tag.
+   @param packet CSP packet, must be valid.
+   @param include_header authenticate the header (this will not modify the flags field)
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_aead_decrypt_packet(csp_packet_t * packet, bool include_header);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
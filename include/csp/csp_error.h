@@ -52,6 +52,7 @@ extern "C" {
 #define CSP_ERR_XTEA		-101		/**< XTEA failed */
 #define CSP_ERR_CRC32		-102		/**< CRC32 failed */
 #define CSP_ERR_SFP		-103		/**< SFP protocol error or inconsistency */
+#define CSP_ERR_AEAD		-104		/**< AEAD authentication failed */
 /**@}*/
 
 typedef enum csp_error_t {
@@ -46,6 +46,15 @@ extern "C" {
 */
 typedef int (*nexthop_t)(const csp_route_t * ifroute, csp_packet_t *packet);
 
+/**
+   Scatter-gather element, for vectored driver Tx functions.
+   Same layout as struct iovec on POSIX, so drivers can pass an array directly to writev().
+*/
+typedef struct {
+    const void * base;         //!< Start of data
+    size_t len;                //!< Length of data
+} csp_iovec_t;
+
 
 typedef struct __attribute__((packed)) {
     uint8_t streamId[2]; /**< \brief packet identifier word (stream ID) */
@@ -34,6 +34,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include <string.h> // memcpy()
+#include <sys/types.h> // off_t
 
 #include <csp/csp_types.h>
 
@@ -105,6 +106,158 @@ static inline int csp_sfp_recv(csp_conn_t * conn, void ** dataout, int * datasiz
     return csp_sfp_recv_fp(conn, dataout, datasize, timeout, NULL);
 }
 
+#if (CSP_POSIX || CSP_MACOSX || __DOXYGEN__)
+/**
+   Send part of a file over a CSP connection.
+
+   The file is mapped with mmap() and handed to csp_sfp_send_own_memcpy(), so each chunk is copied exactly once - from the
+   page cache into the CSP packet. The kernel is told the access is sequential, and the next read-ahead window is requested
+   with madvise() as the transfer moves through the file.
+
+   csp_sfp_recv() or csp_sfp_recv_fp() can be used at the other end to receive data.
+
+   @note The file must not be truncated while the transfer is in progress (accessing a truncated mapping raises SIGBUS).
+
+   @param[in] conn established connection for sending SFP packets.
+   @param[in] fd file descriptor, opened for reading.
+   @param[in] offset offset in file of first byte to send.
+   @param[in] len number of bytes to send, max 4 GB (SFP uses 32 bit offsets).
+   @param[in] mtu maximum transfer unit (bytes), max data chunk to send.
+   @return #CSP_ERR_NONE on success, otherwise an error.
+*/
+int csp_sfp_send_file(csp_conn_t * conn, int fd, off_t offset, size_t len, unsigned int mtu);
+#endif
+
+/**
+   Resumable SFP receive state.
+
+   Keep the state across connections - an interrupted transfer continues from \a offset on the next connection.
+   Zero initialize before first use.
+*/
+typedef struct {
+    //! Received data, allocated with csp_malloc(). Valid up to \a offset.
+    uint8_t * data;
+    //! Total size of the transfer, 0 if no transfer has been started.
+    uint32_t totalsize;
+    //! CRC32 of the complete transfer, identifies the transfer.
+    uint32_t crc;
+    //! Highest contiguous offset received, reported to the sender as checkpoint.
+    uint32_t offset;
+} csp_sfp_resume_t;
+
+/**
+   Send data over a CSP connection, continuing from the receiver's checkpoint.
+
+   The sender asks the receiver for its checkpoint (highest contiguous offset received), and sends the remaining data from there.
+   Chunks carry their absolute offset in the SFP header, so a transfer can be split across any number of connections.
+
+   csp_sfp_recv_resume() must be used at the other end to receive data.
+
+   @param[in] conn established connection for sending SFP packets.
+   @param[in] data data to send
+   @param[in] datasize size of \a data
+   @param[in] mtu maximum transfer unit (bytes), max data chunk to send.
+   @param[in] timeout timeout in ms to wait for the receiver's checkpoint.
+   @return #CSP_ERR_NONE on success (all data sent), otherwise an error.
+*/
+int csp_sfp_send_resume(csp_conn_t * conn, const void * data, unsigned int datasize, unsigned int mtu, uint32_t timeout);
+
+/**
+   Receive data over a CSP connection, continuing from a previous checkpoint.
+
+   This is the counterpart to the csp_sfp_send_resume(). The checkpoint in \a state is reported to the sender, and only data
+   following it is received. Chunks not following the checkpoint are dropped, and will be requested again on the next connection.
+
+   The sender includes the CRC32 of the data in its request. If it starts a different transfer (size or CRC32 differs), the state
+   is discarded and the transfer restarts from offset 0.
+
+   @param[in] conn established connection for receiving SFP packets.
+   @param[in,out] state resume state. On success, \a state->data contains the complete transfer, the caller takes ownership and must
+                  free it with csp_sfp_resume_free(). On failure, the state is kept for the next call.
+   @param[in] timeout timeout in ms to wait for csp_read()
+   @param[in] first_packet First packet of a SFP transfer. Use NULL to receive first packet on the connection.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_TIMEDOUT if the transfer stopped before completion, otherwise an error.
+*/
+int csp_sfp_recv_resume(csp_conn_t * conn, csp_sfp_resume_t * state, uint32_t timeout, csp_packet_t * first_packet);
+
+/**
+   Free resumable SFP receive state.
+
+   Frees received data and resets \a state, so it can be used for a new transfer.
+
+   @param[in] state resume state.
+*/
+void csp_sfp_resume_free(csp_sfp_resume_t * state);
+
+/**
+   Send data over a connection-less (non RDP) CSP connection, with selective retransmission.
+
+   All chunks are sent back-to-back without waiting for acknowledgements. The receiver periodically reports missing chunks
+   with a bitmap NACK, and only those chunks are sent again - similar to CFDP class 2. The transfer completes when the receiver
+   reports all chunks received.
+
+   csp_sfp_recv_window() must be used at the other end to receive data.
+
+   @param[in] conn established connection for sending SFP packets, RDP is not required.
+   @param[in] data data to send
+   @param[in] datasize size of \a data
+   @param[in] mtu maximum transfer unit (bytes), max data chunk to send.
+   @param[in] timeout timeout in ms to wait for a NACK from the receiver.
+   @return #CSP_ERR_NONE on success (receiver has all data), otherwise an error.
+*/
+int csp_sfp_send_window(csp_conn_t * conn, const void * data, unsigned int datasize, unsigned int mtu, uint32_t timeout);
+
+/**
+   Receive data over a connection-less (non RDP) CSP connection, with selective retransmission.
+
+   This is the counterpart to the csp_sfp_send_window(). Chunks are placed by their SFP offset in any order, and a bitmap of
+   missing chunks is sent to the sender every \a nack_interval ms.
+
+   @param[in] conn established connection for receiving SFP packets.
+   @param[out] dataout received data on success. Allocated with csp_malloc(), so should be freed with csp_free(). The pointer will be NULL on failure.
+   @param[out] datasize size of received data.
+   @param[in] nack_interval interval in ms between NACKs.
+   @param[in] timeout timeout in ms without receiving any chunks, before the transfer is abandoned.
+   @param[in] first_packet First packet of a SFP transfer. Use NULL to receive first packet on the connection.
+   @return #CSP_ERR_NONE on success, otherwise an error.
+*/
+int csp_sfp_recv_window(csp_conn_t * conn, void ** dataout, int * datasize, uint32_t nack_interval, uint32_t timeout, csp_packet_t * first_packet);
+
+/**
+   Send data striped across several CSP connections.
+
+   One thread per connection takes the next unsent chunk, until all chunks are sent. Faster connections (e.g. on different
+   interfaces, through different routes) therefore carry more chunks, and the aggregate throughput approaches the sum of the links.
+   Chunks carry their absolute offset in the SFP header.
+
+   csp_sfp_recv_striped() must be used at the other end to receive data.
+
+   @param[in] conns established connections for sending SFP packets.
+   @param[in] count number of connections in \a conns.
+   @param[in] data data to send
+   @param[in] datasize size of \a data
+   @param[in] mtu maximum transfer unit (bytes), max data chunk to send.
+   @param[in] timeout unused
+   @return #CSP_ERR_NONE on success, otherwise an error.
+*/
+int csp_sfp_send_striped(csp_conn_t * conns[], unsigned int count, const void * data, unsigned int datasize, unsigned int mtu, uint32_t timeout);
+
+/**
+   Receive data striped across several CSP connections.
+
+   This is the counterpart to the csp_sfp_send_striped(). One thread per connection places received chunks at their offset,
+   so the data is reassembled in order regardless of which connection delivered a chunk. Received chunks are tracked, so a
+   duplicated chunk (e.g. after a route change) is ignored, and the transfer only completes when every chunk has been received.
+
+   @param[in] conns established connections for receiving SFP packets.
+   @param[in] count number of connections in \a conns.
+   @param[out] dataout received data on success. Allocated with csp_malloc(), so should be freed with csp_free(). The pointer will be NULL on failure.
+   @param[out] datasize size of received data.
+   @param[in] timeout timeout in ms without receiving any chunks on a connection.
+   @return #CSP_ERR_NONE on success, otherwise an error.
+*/
+int csp_sfp_recv_striped(csp_conn_t * conns[], unsigned int count, void ** dataout, int * datasize, uint32_t timeout);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,117 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk) 
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_TIMESTAMP_H_
+#define _CSP_TIMESTAMP_H_
+
+/**
+   @file
+
+   Packet receive timestamps.
+
+   Drivers timestamp received data (socketcan: kernel or hardware timestamp of the CAN frame, USART: time of read()),
+   and the timestamp of the data completing a packet is stored in the packet. It can be read after csp_read(),
+   csp_recvfrom() etc. with csp_packet_get_rx_timestamp().
+
+   The clock of a timestamp is recorded with it (#csp_timestamp_clock_t):
+   - Driver timestamps are CLOCK_MONOTONIC, so they don't step when the time is set (e.g. csp_clock_set_time() on a CSP
+     time sync). Latency within the node is clock_gettime(CLOCK_MONOTONIC) minus the receive timestamp.
+   - Kernel timestamps are CLOCK_REALTIME (nS since 1970), so with synchronized clocks, one-way latency is the receive
+     timestamp minus a send time carried in the payload.
+   - Hardware timestamps use the device clock.
+
+   @note The timestamp is kept in csp_packet_t::padding, and is lost if the padding is used for sending the packet.
+*/
+
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Timestamp source.
+*/
+typedef enum {
+    CSP_TIMESTAMP_NONE = 0,     //!< No timestamp
+    CSP_TIMESTAMP_DRIVER = 1,   //!< Taken by the driver, when the data was read from the device
+    CSP_TIMESTAMP_KERNEL = 2,   //!< Taken by the kernel, when the frame was received by the network stack
+    CSP_TIMESTAMP_HARDWARE = 3, //!< Taken by the device, device clock
+} csp_timestamp_source_t;
+
+/**
+   Timestamp clock.
+*/
+typedef enum {
+    CSP_TIMESTAMP_CLOCK_REALTIME = 0,  //!< CLOCK_REALTIME, nS since 1970
+    CSP_TIMESTAMP_CLOCK_MONOTONIC = 1, //!< CLOCK_MONOTONIC
+    CSP_TIMESTAMP_CLOCK_DEVICE = 2,    //!< Device clock
+} csp_timestamp_clock_t;
+
+/**
+   Receive timestamp.
+*/
+typedef struct {
+    //! Time in nS, see \a clock.
+    uint64_t ns;
+    //! Source, see #csp_timestamp_source_t.
+    uint8_t source;
+    //! Clock, see #csp_timestamp_clock_t.
+    uint8_t clock;
+} csp_rx_timestamp_t;
+
+/**
+   Get receive timestamp of packet.
+
+   @param[in] packet received packet.
+   @param[out] ts timestamp.
+   @return \a true if the packet has a receive timestamp, otherwise \a false (\a ts is cleared).
+*/
+bool csp_packet_get_rx_timestamp(const csp_packet_t * packet, csp_rx_timestamp_t * ts);
+
+/**
+   Set receive timestamp of packet (drivers).
+
+   @param[out] packet packet.
+   @param[in] ts timestamp, NULL (or source #CSP_TIMESTAMP_NONE) clears the timestamp.
+*/
+void csp_packet_set_rx_timestamp(csp_packet_t * packet, const csp_rx_timestamp_t * ts);
+
+/**
+   Set receive timestamp for packets passed to csp_qfifo_write() by the calling thread (drivers).
+
+   For drivers handing data to a deframer (e.g. csp_kiss_rx()), which completes the packets. Set the timestamp before
+   passing the data, and clear it again if the thread also receives data without timestamps.
+
+   @param[in] ts timestamp, NULL clears the timestamp.
+*/
+void csp_rx_timestamp_set(const csp_rx_timestamp_t * ts);
+
+/**
+   Get current time as a #CSP_TIMESTAMP_DRIVER timestamp (#CSP_TIMESTAMP_CLOCK_MONOTONIC).
+
+   @param[out] ts timestamp.
+*/
+void csp_timestamp_now(csp_rx_timestamp_t * ts);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
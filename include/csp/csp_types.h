@@ -252,7 +252,7 @@ typedef union {
 */
 #define CSP_FRES1			0x80 //!< Reserved for future use
 #define CSP_FRES2			0x40 //!< Reserved for future use
-#define CSP_FRES3			0x20 //!< Reserved for future use
+#define CSP_FAEAD			0x20 //!< Use AEAD (ChaCha20-Poly1305) encryption and authentication
 #define CSP_FFRAG			0x10 //!< Use fragmentation
 #define CSP_FHMAC			0x08 //!< Use HMAC verification
 #define CSP_FXTEA			0x04 //!< Use XTEA encryption
@@ -274,6 +274,8 @@ typedef union {
 #define CSP_SO_CRC32REQ			0x0040 //!< Require CRC32
 #define CSP_SO_CRC32PROHIB		0x0080 //!< Prohibit CRC32
 #define CSP_SO_CONN_LESS		0x0100 //!< Enable Connection Less mode
+#define CSP_SO_AEADREQ			0x0200 //!< Require AEAD
+#define CSP_SO_AEADPROHIB		0x0400 //!< Prohibit AEAD
 #define CSP_SO_INTERNAL_LISTEN          0x1000 //!< Internal flag: listen called on socket
 /**@}*/
 
@@ -290,6 +292,8 @@ typedef union {
 #define CSP_O_NOXTEA			CSP_SO_XTEAPROHIB  //!< Disable XTEA
 #define CSP_O_CRC32			CSP_SO_CRC32REQ    //!< Enable CRC32
 #define CSP_O_NOCRC32			CSP_SO_CRC32PROHIB //!< Disable CRC32
+#define CSP_O_AEAD			CSP_SO_AEADREQ     //!< Enable AEAD
+#define CSP_O_NOAEAD			CSP_SO_AEADPROHIB  //!< Disable AEAD
 /**@}*/
 
 /**
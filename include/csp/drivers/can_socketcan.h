@@ -47,6 +47,22 @@ int csp_can_open_and_add_interface(const char * device, const char * ifname, int
 */
 int csp_can_socketcan_open_and_add_interface(const char * device, const char * ifname, int bitrate, bool promisc, csp_iface_t ** return_iface);
 
+/**
+   Open CAN FD socket and add CSP interface.
+
+   Same as csp_can_socketcan_open_and_add_interface(), but CSP packets are sent in CAN FD frames with up to #CSP_CANFD_FRAME_SIZE
+   bytes (bit rate switch enabled). All nodes on the bus must use CAN FD. The device MTU must be CANFD_MTU,
+   e.g. for vcan: "ip link set vcan0 mtu 72".
+
+   @param[in] device CAN device name (Linux device).
+   @param[in] ifname CSP interface name, use #CSP_IF_CAN_DEFAULT_NAME for default name.
+   @param[in] bitrate if different from 0, it will be attempted to change the (nominal) bitrate on the CAN device - this may require increased OS privileges.
+   @param[in] promisc if \a true, receive all CAN frames. If \a false a filter is set on the CAN device, using csp_get_address().
+   @param[out] return_iface the added interface.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_can_socketcan_open_and_add_interface_fd(const char * device, const char * ifname, int bitrate, bool promisc, csp_iface_t ** return_iface);
+
 /**
    Initialize socketcan and add CSP interface.
 
@@ -26,7 +26,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
    USART driver.
 
-   @note This interface implementation only support ONE open UART connection.
+   Any number of UART devices can be open at the same time, each open call (and each interface added) is an independent
+   instance. On Linux, a single Rx thread serves all open devices.
 */
 
 #include <csp/interfaces/csp_if_kiss.h>
@@ -49,6 +50,16 @@ extern "C" {
     typedef int csp_usart_fd_t;
 #endif
 
+/**
+   Callback for reporting a device failure to the application.
+
+   Called from the Rx thread when reading fails - the device is then reopened with backoff.
+
+   @param[in] user_data reference given to csp_usart_open().
+   @param[in] error errno of the failure.
+*/
+typedef void (*csp_usart_error_callback_t) (void * user_data, int error);
+
 /**
    Usart configuration.
    @see csp_usart_open()
@@ -56,7 +67,7 @@ extern "C" {
 typedef struct csp_usart_conf {
     //! USART device.
     const char *device;
-    //! bits per second.
+    //! bits per second. On Linux, rates without a Bxxx constant are set with termios2 (BOTHER).
     uint32_t baudrate;
     //! Number of data bits.
     uint8_t databits;
@@ -66,6 +77,20 @@ typedef struct csp_usart_conf {
     uint8_t paritysetting;
     //! Enable parity checking (Windows only).
     uint8_t checkparity;
+    //! Set ASYNC_LOW_LATENCY on the device, if the serial driver supports it (Linux only).
+    uint8_t low_latency;
+    //! termios VMIN - minimum bytes per read(), 0 = default (1). Values above 1 require \a vtime (Linux only).
+    uint8_t vmin;
+    //! termios VTIME - inter-byte timeout in 1/10 S, 0 = none. With \a vmin, read() waits up to this time for each
+    //! further byte, blocking the Rx thread shared by all devices meanwhile (Linux only).
+    uint8_t vtime;
+    //! Max bytes per read() in the Rx thread, 0 = default (400) (Linux only).
+    uint16_t rx_chunk_size;
+    //! Inter-byte gap in uS - after a read(), keep reading while more data arrives within the gap, up to \a rx_chunk_size.
+    //! 0 = one read() per wakeup (Linux only).
+    uint32_t rx_gap_us;
+    //! Called on device failure, NULL = none. Set by the csp_usart_open_and_add_*_interface() functions (Linux only).
+    csp_usart_error_callback_t error_callback;
 } csp_usart_conf_t;
 
 /**
@@ -80,9 +105,17 @@ typedef void (*csp_usart_callback_t) (void * user_data, uint8_t *buf, size_t len
 /**
    Opens an UART device.
 
-   Opens the UART device and creates a thread for reading/returning data to the application.
+   Opens the UART device and registers it with the Rx thread (shared by all devices), which reads and returns data to the
+   application.
+
+   Rx latency/throughput is tuned with csp_usart_conf_t: \a vmin and \a rx_chunk_size batch data into fewer, larger
+   callbacks, \a low_latency disables the driver's receive buffering delay. \a vtime and \a rx_gap_us wait for further
+   data after a read, which delays the other devices served by the Rx thread by up to that time. \a vmin above 1 without
+   \a vtime is rejected (#CSP_ERR_INVAL), a quiet device would block the Rx thread - and all other devices - forever.
+   \a rx_gap_us is preferred for batching, it waits with poll() and never blocks for longer than the gap.
 
-   @note On read failure, exit() will be called - terminating the process.
+   @note On read failure, the device is reopened with backoff (100 mS doubling up to 5 S), until it succeeds. Writes fail
+         in the meantime. Failures are reported with \a conf->error_callback.
 
    @param[in] conf UART configuration.
    @param[in] rx_callback receive data callback.
@@ -102,12 +135,26 @@ int csp_usart_open(const csp_usart_conf_t *conf, csp_usart_callback_t rx_callbac
 */
 int csp_usart_write(csp_usart_fd_t fd, const void * data, size_t data_length);
 
+/**
+   Write a list of buffers on open UART.
+
+   The buffers are written with a single writev() - a frame passed as one list is not interleaved with other writes, and
+   costs one system call. Partial writes are completed before returning.
+
+   @param[in] fd file descriptor.
+   @param[in] iov buffers to write, in order.
+   @param[in] iovcnt number of buffers in \a iov.
+   @return number of bytes written on success, a negative value on failure.
+*/
+int csp_usart_writev(csp_usart_fd_t fd, const csp_iovec_t * iov, unsigned int iovcnt);
+
 /**
    Opens UART device and add KISS interface.
 
    This is a convience function for opening an UART device and adding it as an interface with a given name.
 
-   @note On read failures, exit() will be called - terminating the process.
+   @note On read failures, the device is reopened with backoff and the interface stays registered. Failures are counted
+         in the interface rx_error, and a partly received frame is dropped and counted in frame.
 
    @param[in] conf UART configuration.
    @param[in] ifname internface name (will be copied), or use NULL for default name.
@@ -121,8 +168,6 @@ int csp_usart_open_and_add_kiss_interface(const csp_usart_conf_t *conf, const ch
 
    This is a convience function for opening an UART device and adding it as an interface with a given name.
 
-   @note On read failures, exit() will be called - terminating the process.
-
    @param[in] conf UART configuration.
    @param[in] ifname internface name (will be copied), or use NULL for default name.
    @param[out] return_iface the added interface.
@@ -135,7 +180,8 @@ int csp_usart_open_and_add_ccsds_interface(const csp_usart_conf_t *conf, const c
 
    This is a convience function for opening an UART device and adding it as an interface with a given name.
 
-   @note On read failures, exit() will be called - terminating the process.
+   @note On read failures, the device is reopened with backoff and the interface stays registered. Failures are counted
+         in the interface rx_error, and a partly received frame is dropped and counted in frame.
 
    @param[in] conf UART configuration.
    @param[in] ifname internface name (will be copied), or use NULL for default name.
@@ -149,7 +195,8 @@ int csp_usart_open_and_add_ewc_interface(const csp_usart_conf_t *conf, const cha
 
    This is a convience function for opening an UART device and adding it as an interface with a given name.
 
-   @note On read failures, exit() will be called - terminating the process.
+   @note On read failures, the device is reopened with backoff and the interface stays registered. Failures are counted
+         in the interface rx_error, and a partly received frame is dropped and counted in frame.
 
    @param[in] conf UART configuration.
    @param[in] ifname internface name (will be copied), or use NULL for default name.
@@ -163,8 +210,6 @@ int csp_usart_open_and_add_ms200_interface(const csp_usart_conf_t *conf, const c
 
    This is a convience function for opening an UART device and adding it as an interface with a given name.
 
-   @note On read failures, exit() will be called - terminating the process.
-
    @param[in] conf UART configuration.
    @param[in] ifname internface name (will be copied), or use NULL for default name.
    @param[out] return_iface the added interface.
@@ -48,6 +48,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include <csp/csp_interface.h>
+#include <csp/csp_timestamp.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -108,6 +109,19 @@ extern "C" {
 				 CFP_MAKE_DST((uint32_t)(1 << CFP_HOST_SIZE) - 1) | \
 				 CFP_MAKE_ID((uint32_t)(1 << CFP_ID_SIZE) - 1))
 
+/**
+   Max data bytes in a CAN 2.0 frame.
+*/
+#define CSP_CAN_FRAME_SIZE	8
+
+/**
+   Max data bytes in a CAN FD frame.
+
+   With CAN FD, fragments are sent with up to 64 bytes - about 8 times fewer frames per packet. The last fragment may be padded
+   by the driver to a valid CAN FD length, the padding is ignored by csp_can_rx().
+*/
+#define CSP_CANFD_FRAME_SIZE	64
+
 /**
    Default interface name.
 */
@@ -121,11 +135,42 @@ extern "C" {
    @param[in] driver_data driver data from #csp_iface_t
    @param[in] id CAM message id.
    @param[in] data CAN data 
-   @param[in] dlc data length of \a data.
+   @param[in] dlc data length of \a data, max csp_can_interface_data_t::frame_size.
    @return #CSP_ERR_NONE on success, otherwise an error code.
 */
 typedef int (*csp_can_driver_tx_t)(void * driver_data, uint32_t id, const uint8_t * data, uint8_t dlc);
 
+/**
+   CAN frame, for burst transmit and receive.
+*/
+typedef struct {
+    /** CAN message id (29 bit, no flags). */
+    uint32_t id;
+    /** Data length of \a data. */
+    uint8_t dlc;
+    /** CAN data. */
+    uint8_t data[CSP_CANFD_FRAME_SIZE];
+    /** Receive timestamp (optional, ignored on transmit), set on the packet completed by this frame. */
+    csp_rx_timestamp_t timestamp;
+} csp_can_frame_t;
+
+/**
+   Max number of frames passed to csp_can_driver_tx_burst_t in one call.
+*/
+#define CSP_CAN_TX_BURST	32
+
+/**
+   Send several CAN frames (optional, implemented by driver).
+
+   Used by csp_can_tx() instead of csp_can_driver_tx_t, if set. Frames must be sent in order.
+
+   @param[in] driver_data driver data from #csp_iface_t
+   @param[in] frames CAN frames.
+   @param[in] count number of frames in \a frames, max #CSP_CAN_TX_BURST.
+   @return #CSP_ERR_NONE on success (all frames sent), otherwise an error code.
+*/
+typedef int (*csp_can_driver_tx_burst_t)(void * driver_data, const csp_can_frame_t * frames, unsigned int count);
+
 /**
    Interface data (state information).
 */
@@ -134,6 +179,10 @@ typedef struct {
     uint32_t cfp_frame_id;
     /** Tx function */
     csp_can_driver_tx_t tx_func;
+    /** Max data bytes per CAN frame: #CSP_CAN_FRAME_SIZE (0 also means this) or #CSP_CANFD_FRAME_SIZE. */
+    uint8_t frame_size;
+    /** Burst tx function (optional), sends all fragments of a packet with a few driver calls. */
+    csp_can_driver_tx_burst_t tx_burst_func;
 } csp_can_interface_data_t;
 
 /**
@@ -150,6 +199,8 @@ int csp_can_add_interface(csp_iface_t * iface);
    Send CSP packet over CAN (nexthop).
 
    This function will split the CSP packet into several fragments and call csp_can_tx_fram() for sending each fragment.
+   Fragments carry up to csp_can_interface_data_t::frame_size bytes (8 for CAN 2.0, 64 for CAN FD). If the driver sets
+   csp_can_interface_data_t::tx_burst_func, fragments are passed to the driver #CSP_CAN_TX_BURST at a time.
 
    @param[in] ifroute route.
    @param[in] packet CSP packet to send.
@@ -160,7 +211,7 @@ int csp_can_tx(const csp_route_t * ifroute, csp_packet_t *packet);
 /**
    Process received CAN frame.
 
-   Called from driver when a single CAN frame (up to 8 bytes) has been received. The function will gather the fragments into a single
+   Called from driver when a single CAN frame (up to 8 bytes, or 64 bytes for CAN FD) has been received. The function will gather the fragments into a single
    CSP packet and route it on when complete.
 
    @param[in] iface incoming interface.
@@ -172,6 +223,59 @@ int csp_can_tx(const csp_route_t * ifroute, csp_packet_t *packet);
 */
 int csp_can_rx(csp_iface_t * iface, uint32_t id, const uint8_t * data, uint8_t dlc, CSP_BASE_TYPE *pxTaskWoken);
 
+/**
+   Process several received CAN frames.
+
+   Same as calling csp_can_rx() for each frame, but the packet buffers are only locked once.
+
+   @param[in] iface incoming interface.
+   @param[in] frames received CAN frames, in the order received.
+   @param[in] count number of frames in \a frames.
+   @param[out] pxTaskWoken Valid reference if called from ISR, otherwise NULL!
+   @return #CSP_ERR_NONE if all frames were processed, otherwise the error code of the last failing frame.
+*/
+int csp_can_rx_burst(csp_iface_t * iface, const csp_can_frame_t * frames, unsigned int count, CSP_BASE_TYPE *pxTaskWoken);
+
+/**
+   Default number of CAN packet buffers (packets being reassembled at the same time, across all CAN interfaces).
+*/
+#define CSP_CAN_PBUF_DEFAULT_SIZE 32
+
+/**
+   CAN packet buffer statistics.
+
+   The drop counters count partial packets (or fragments) discarded by csp_can_rx(), per reason.
+*/
+typedef struct {
+    uint32_t size;          //!< Number of packet buffers
+    uint32_t used;          //!< Packet buffers in use
+    uint32_t completed;     //!< Packets reassembled
+    uint32_t timeout;       //!< Dropped: no fragment received for 1 second
+    uint32_t evicted;       //!< Dropped: least recently used packet, all buffers were in use when a new packet began
+    uint32_t no_buffer;     //!< Dropped: no free CSP buffer
+    uint32_t no_begin;      //!< Dropped fragment: no packet in progress (BEGIN fragment lost or dropped)
+    uint32_t sequence;      //!< Dropped: fragment out of sequence
+    uint32_t restarted;     //!< Dropped: new BEGIN fragment while the packet was in progress
+    uint32_t malformed;     //!< Dropped: BEGIN fragment too short, invalid length or too much data
+} csp_can_pbuf_stats_t;
+
+/**
+   Set number of CAN packet buffers.
+
+   The default is #CSP_CAN_PBUF_DEFAULT_SIZE. Packets being reassembled are dropped, so call this before adding CAN interfaces.
+
+   @param[in] size number of packet buffers, 1 - 4096.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_can_pbuf_set_size(unsigned int size);
+
+/**
+   Get CAN packet buffer statistics.
+
+   @param[out] stats statistics.
+*/
+void csp_can_pbuf_get_stats(csp_can_pbuf_stats_t * stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,6 +49,18 @@ extern "C" {
 */
 typedef int (*csp_ewc_driver_tx_t)(void *driver_data, const uint8_t * data, size_t len);
 
+/**
+   Send EWC frame as a list of buffers (implemented by driver, optional).
+
+   The interface passes a complete frame in one call, so the driver can send it with a single write (e.g. writev()).
+
+   @param[in] driver_data driver data from #csp_iface_t
+   @param[in] iov buffers to send, in order.
+   @param[in] iovcnt number of buffers in \a iov.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+typedef int (*csp_ewc_driver_txv_t)(void *driver_data, const csp_iovec_t * iov, unsigned int iovcnt);
+
 /**
    EWC Rx mode/state.
 */
@@ -77,13 +89,16 @@ typedef struct {
 
    uint8_t                 hostNodeNum;
    uint8_t                 nodeNum;
+   /** Not used by csp_ewc_rx(), the message is parsed directly into \a rx_packet. Kept for the libcsp.so layout. */
    EWC_MessagePack_t       rxMsg;
+   /** Rx header (type char and 2 hex digits length) */
    uint8_t                 rxBuff[10];
+   /** Rx hex digits in current field, #EWC_RX_FIELD_END after a non-hex char */
    uint8_t                 dataCount;
    uint8_t                 syncWordCount;
    uint8_t                 sPort;
    
-   // For CRC
+   /** Last received bytes of the frame (\a rxTempBuffCount bytes), not yet added to \a rx_crc - CRC16 and endSyncWord are not included in the CRC */
    uint8_t                 rxTempBuff[120];
    uint8_t                 rxTempBuffCount;
    
@@ -97,8 +112,19 @@ typedef struct {
 	uint16_t                rx_length;
 	/** CSP packet for storing Rx data. */
 	csp_packet_t            *rx_packet;
+	/** Vectored Tx function, used instead of \a tx_func if set. Kept last, libcsp.so does not know this field. */
+	csp_ewc_driver_txv_t    txv_func;
+	/** Rx CRC16 of the frame so far. Kept after \a txv_func, libcsp.so does not know this field. */
+	uint16_t                rx_crc;
+	/** Rx value of the current field (hex). Kept after \a txv_func, libcsp.so does not know this field. */
+	uint32_t                rx_value;
 } csp_ewc_interface_data_t;
 
+/**
+   Value of csp_ewc_interface_data_t::dataCount, after a non-hex char in a field - the rest of the field is ignored.
+*/
+#define EWC_RX_FIELD_END        0xFF
+
 /**
    Add interface.
 
@@ -119,10 +145,14 @@ int csp_ewc_add_interface(csp_iface_t * iface);
 int csp_ewc_tx(const csp_route_t * ifroute, csp_packet_t * packet);
 
 /**
-   Process received CAN frame.
+   Process received EWC data.
 
    Called from driver when a chunk of data has been received. Once a complete frame has been received, the CSP packet will be routed on.
 
+   Frame format: '<', type char, length (2 hex digits), separator char, fields of hex digits terminated by ':', CRC16 (4 hex
+   digits) and endSyncWord. Type 'T' is a trace frame, which is skipped. The CSP packet data is a #EWC_Message_t with
+   up to (MTU - 2) / 4 fields.
+
    @param[in] iface incoming interface.
    @param[in] buf reveived data.
    @param[in] len length of \a buf.
@@ -132,8 +162,33 @@ void csp_ewc_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * pxT
 
 int csp_ewc_setConfig(csp_iface_t * iface, uint8_t hostNode, uint8_t node);
 
+/**
+   Calculate CRC16 (poly 0x1021, init 0) of a buffer.
+
+   @param[in] pData data
+   @param[in] len length of \a pData
+   @return CRC16
+*/
 uint16_t csp_crc16_memory(const uint8_t *pData, uint16_t len);
 
+/**
+   Update a running CRC16 with more data.
+
+   Allows a frame to be checksummed in chunks as it is received: start with \a crc = 0, and the result after the last
+   chunk equals csp_crc16_memory() over the whole frame.
+
+   @param[in] crc CRC16 of the preceding data, 0 for the first chunk.
+   @param[in] data data
+   @param[in] len length of \a data
+   @return updated CRC16
+*/
+uint16_t csp_crc16_update(uint16_t crc, const uint8_t * data, size_t len);
+
+/**
+   EWC frame terminator (">\r\n"), sent after the CRC16.
+*/
+extern const uint8_t endSyncWord[3];
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,6 +49,18 @@ extern "C" {
 */
 typedef int (*csp_kiss_driver_tx_t)(void *driver_data, const uint8_t * data, size_t len);
 
+/**
+   Send KISS frame as a list of buffers (implemented by driver, optional).
+
+   The interface passes a complete frame in one call, so the driver can send it with a single write (e.g. writev()).
+
+   @param[in] driver_data driver data from #csp_iface_t
+   @param[in] iov buffers to send, in order.
+   @param[in] iovcnt number of buffers in \a iov.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+typedef int (*csp_kiss_driver_txv_t)(void *driver_data, const csp_iovec_t * iov, unsigned int iovcnt);
+
 /**
    KISS Rx mode/state.
 */
@@ -77,6 +89,8 @@ typedef struct {
 	bool rx_first;
 	/** CSP packet for storing Rx data. */
 	csp_packet_t * rx_packet;
+	/** Vectored Tx function, used instead of \a tx_func if set. Kept last, libcsp.so does not know this field. */
+	csp_kiss_driver_txv_t txv_func;
 } csp_kiss_interface_data_t;
 
 /**
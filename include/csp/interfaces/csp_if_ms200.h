@@ -49,6 +49,18 @@ extern "C" {
 */
 typedef int (*csp_ms200_driver_tx_t)(void *driver_data, const uint8_t * data, size_t len);
 
+/**
+   Send MS200 frame as a list of buffers (implemented by driver, optional).
+
+   The interface passes a complete frame in one call, so the driver can send it with a single write (e.g. writev()).
+
+   @param[in] driver_data driver data from #csp_iface_t
+   @param[in] iov buffers to send, in order.
+   @param[in] iovcnt number of buffers in \a iov.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+typedef int (*csp_ms200_driver_txv_t)(void *driver_data, const csp_iovec_t * iov, unsigned int iovcnt);
+
 /**
    MS200 Rx mode/state.
 */
@@ -70,7 +82,9 @@ typedef struct {
 
    uint8_t                    hostNodeNum;
    uint8_t                    nodeNum;
+   /** Rx frame length following the sync word, from the header */
    uint16_t                   dataLength;
+   /** Rx bytes of a sync word, split between chunks */
    uint8_t                    syncWordCount;
 
 	/** Tx function */
@@ -83,7 +97,10 @@ typedef struct {
 	unsigned int               rx_length;
 	/** CSP packet for storing Rx data. */
 	csp_packet_t               *rx_packet;
+   /** Rx header, if it is split between chunks. The payload is stored directly in \a rx_packet. */
    uint8_t                    rxData[255];
+	/** Vectored Tx function, used instead of \a tx_func if set. Kept last, libcsp.so does not know this field. */
+	csp_ms200_driver_txv_t     txv_func;
 } csp_ms200_interface_data_t;
 
 /**
@@ -106,10 +123,13 @@ int csp_ms200_add_interface(csp_iface_t * iface);
 int csp_ms200_tx(const csp_route_t * ifroute, csp_packet_t * packet);
 
 /**
-   Process received CAN frame.
+   Process received MS200 data.
 
    Called from driver when a chunk of data has been received. Once a complete frame has been received, the CSP packet will be routed on.
 
+   Frame format: #MS200_Header_t followed by the payload, which becomes the CSP packet data. The payload can be up to
+   csp_buffer_data_size() bytes, frames with a longer (or too short) length field are counted as Rx errors.
+
    @param[in] iface incoming interface.
    @param[in] buf reveived data.
    @param[in] len length of \a buf.
@@ -118,6 +138,15 @@ int csp_ms200_tx(const csp_route_t * ifroute, csp_packet_t * packet);
 void csp_ms200_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * pxTaskWoken);
 
 int csp_ms200_setConfig(csp_iface_t * iface, uint8_t hostNode, uint8_t node);
+
+/**
+   MS200 frame header constants (fields of #MS200_Header_t).
+*/
+extern const uint8_t ms200SyncWord[4];
+extern const uint8_t ms200AppId[2];
+extern const uint8_t ms200Sequence[2];
+extern const uint8_t ms200SecondaryHeader[9];
+
 #ifdef __cplusplus
 }
 #endif
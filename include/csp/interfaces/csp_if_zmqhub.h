@@ -28,6 +28,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
    The ZMQ interface is designed to connect to a ZMQ hub, also refered to as \a zmqproxy. The zmqproxy can be found under examples,
    and is based on zmq_proxy() - provided by the ZMQ API.
 
+   Tx is zero-copy: ZMQ sends directly from the CSP buffer, and frees it when sent. At most 1/4 of the CSP buffers
+   (csp_conf_t::buffers) are held by ZMQ this way, further packets are copied while ZMQ has a backlog.
+
    For further details on ZMQ, see http://www.zeromq.org.
 */
 
@@ -54,10 +57,17 @@ extern "C" {
 */
 #define CSP_ZMQHUB_IF_NAME            "ZMQHUB"
 
+/**
+   Host name for in-process endpoints.
+   Endpoints made with this host use the inproc:// transport, and can only be used within the process - e.g. with a
+   zmqproxy started by csp_zmqhub_proxy_start(). Messages are passed in memory, without any network.
+*/
+#define CSP_ZMQHUB_INPROC_HOST        "inproc"
+
 /**
    Format endpoint connection string for ZMQ.
 
-   @param[in] host host name of IP.
+   @param[in] host host name of IP, or #CSP_ZMQHUB_INPROC_HOST for an in-process endpoint.
    @param[in] port IP port.
    @param[out] buf user allocated buffer for receiving formatted string.
    @param[in] buf_size size of \a buf.
@@ -72,7 +82,7 @@ int csp_zmqhub_make_endpoint(const char * host, uint16_t port, char * buf, size_
    @param[in] host host name or IP of zmqproxy host. Endpoints are created using the \a host and the default subscribe/publish ports.
    @param[in] flags flags for controlling features on the connection.
    @param[out] return_interface created CSP interface.
-   @return #CSP_ERR_NONE on succcess - else assert.
+   @return #CSP_ERR_NONE on succcess, otherwise an error code.
 */
 int csp_zmqhub_init(uint8_t addr,
                     const char * host,
@@ -86,7 +96,7 @@ int csp_zmqhub_init(uint8_t addr,
    @param[in] subscribe_endpoint subscribe (rx) endpoint -> connect to zmqproxy's publish port #CSP_ZMQPROXY_PUBLISH_PORT.
    @param[in] flags flags for controlling features on the connection.
    @param[out] return_interface created CSP interface.
-   @return #CSP_ERR_NONE on succcess - else assert.
+   @return #CSP_ERR_NONE on succcess, otherwise an error code.
 */
 int csp_zmqhub_init_w_endpoints(uint8_t addr,
                                 const char * publish_endpoint,
@@ -97,13 +107,14 @@ int csp_zmqhub_init_w_endpoints(uint8_t addr,
 /**
    Setup ZMQ interface.
    @param[in] ifname Name of CSP interface, use NULL for default name #CSP_ZMQHUB_IF_NAME.
-   @param[in] rx_filter Rx filters, use NULL for no filters - receive all messages.
+   @param[in] rx_filter Rx filters, use NULL for no filters - receive all messages. Each filter is subscribed as a prefix
+              on the first byte of the message (address/via), so the zmqproxy only sends matching messages to this client.
    @param[in] rx_filter_count Number of Rx filters in \a rx_filter.
    @param[in] publish_endpoint publish (tx) endpoint -> connect to zmqproxy's subscribe port #CSP_ZMQPROXY_SUBSCRIBE_PORT.
    @param[in] subscribe_endpoint subscribe (rx) endpoint -> connect to zmqproxy's publish port #CSP_ZMQPROXY_PUBLISH_PORT.
    @param[in] flags flags for controlling features on the connection.
    @param[out] return_interface created CSP interface.
-   @return #CSP_ERR_NONE on succcess - else assert.
+   @return #CSP_ERR_NONE on succcess, otherwise an error code.
 */
 int csp_zmqhub_init_w_name_endpoints_rxfilter(const char * ifname,
                                               const uint8_t rx_filter[], unsigned int rx_filter_count,
@@ -112,6 +123,66 @@ int csp_zmqhub_init_w_name_endpoints_rxfilter(const char * ifname,
                                               uint32_t flags,
                                               csp_iface_t ** return_interface);
 
+/**
+   Default max number of messages received in a burst, before they are passed on to the router.
+*/
+#define CSP_ZMQHUB_RX_BURST           16
+
+/**
+   ZMQ interface configuration.
+   @see csp_zmqhub_init_w_conf()
+*/
+typedef struct csp_zmqhub_conf {
+    //! Name of CSP interface, NULL for default name #CSP_ZMQHUB_IF_NAME.
+    const char * ifname;
+    //! Rx filters (address/via of the message), NULL for no filters - receive all messages. Subscribed as ZMQ prefixes.
+    const uint8_t * rx_filter;
+    //! Number of Rx filters in \a rx_filter.
+    unsigned int rx_filter_count;
+    //! publish (tx) endpoint -> connect to zmqproxy's subscribe port #CSP_ZMQPROXY_SUBSCRIBE_PORT.
+    const char * publish_endpoint;
+    //! subscribe (rx) endpoint -> connect to zmqproxy's publish port #CSP_ZMQPROXY_PUBLISH_PORT.
+    const char * subscribe_endpoint;
+    //! flags for controlling features on the connection.
+    uint32_t flags;
+    //! Number of ZMQ I/O threads (ZMQ_IO_THREADS), 0 = ZMQ default (1).
+    unsigned int io_threads;
+    //! Number of subscribe sockets, each with its own Rx thread, 0 = 1. The subscriptions are divided between the sockets.
+    unsigned int rx_sockets;
+    //! Max number of messages received in a burst, 0 = default (#CSP_ZMQHUB_RX_BURST).
+    unsigned int rx_burst;
+} csp_zmqhub_conf_t;
+
+/**
+   Setup ZMQ interface.
+
+   Each subscribe socket is served by its own Rx thread, which receives a burst of up to \a rx_burst messages (without
+   waiting, once the first message has arrived) before passing them on to the router. The subscriptions - the Rx filters,
+   or all 256 addresses if there are no filters - are divided between the sockets, so each message is received once. Messages
+   to the same address are received on the same socket, so their order is kept.
+
+   @param[in] conf interface configuration.
+   @param[out] return_interface created CSP interface.
+   @return #CSP_ERR_NONE on succcess, otherwise an error code.
+*/
+int csp_zmqhub_init_w_conf(const csp_zmqhub_conf_t * conf, csp_iface_t ** return_interface);
+
+/**
+   Start a zmqproxy in this process.
+
+   The proxy binds a subscribe (XSUB) and a publish (XPUB) socket, and forwards messages and subscriptions between them
+   with zmq_proxy() in its own thread. The sockets are bound before returning, so interfaces can connect right away.
+
+   In-process (inproc://) endpoints share a ZMQ context with the ZMQ interfaces in this process, so a simulation with
+   several nodes can run in one process without any network. TCP endpoints can be used as well, e.g. to let other
+   processes connect.
+
+   @param[in] subscribe_endpoint subscribe endpoint, clients connect their publish (tx) endpoint to this, e.g. #CSP_ZMQPROXY_SUBSCRIBE_PORT.
+   @param[in] publish_endpoint publish endpoint, clients connect their subscribe (rx) endpoint to this, e.g. #CSP_ZMQPROXY_PUBLISH_PORT.
+   @return #CSP_ERR_NONE on succcess, otherwise an error code.
+*/
+int csp_zmqhub_proxy_start(const char * subscribe_endpoint, const char * publish_endpoint);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,78 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+/**
+   @file
+
+   Microbenchmarks, run with: csp_shlib_test -b <name>
+*/
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+   Monotonic time in nS.
+*/
+static inline uint64_t bench_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/**
+   Benchmark csp_crc32_memory() against the bytewise table version.
+   @return 0 on success, non-zero if results differ.
+*/
+int bench_crc32(void);
+
+/**
+   Benchmark csp_crc16_memory() against the bytewise CRC16_TABLE version, and csp_crc16_update() in chunks.
+   @return 0 on success, non-zero if results differ.
+*/
+int bench_crc16(void);
+
+/**
+   Benchmark csp_hmac_append() (cached key midstate) against csp_hmac_memory().
+   @return 0 on success, non-zero if results differ.
+*/
+int bench_hmac(void);
+
+/**
+   Benchmark csp_aead_encrypt_packet() against csp_xtea_encrypt_packet() + csp_hmac_append().
+   @return 0 on success, non-zero if round trip or authentication fails.
+*/
+int bench_aead(void);
+
+/**
+   Benchmark csp_kiss_rx() against the bytewise state machine, per frame.
+   @return 0 on success, non-zero if results differ.
+*/
+int bench_kiss(void);
+
+/**
+   Benchmark the USART driver Rx path over a pty, for several csp_usart_conf_t settings: frames per second and latency per frame.
+   @return 0 on success, non-zero if frames are lost.
+*/
+int bench_usart(void);
+
+#endif
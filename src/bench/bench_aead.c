@@ -0,0 +1,103 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/crypto/csp_aead.h>
+#include <csp/crypto/csp_hmac.h>
+#include <csp/crypto/csp_xtea.h>
+
+/* Packet sizes to measure */
+static const uint16_t sizes[] = {16, 64, 200, 1024};
+
+int bench_aead(void) {
+
+    const uint8_t key[] = "bench key";
+    csp_xtea_set_key(key, sizeof(key));
+    csp_hmac_set_key(key, sizeof(key));
+    csp_aead_set_key(key, sizeof(key));
+
+    csp_packet_t * packet = calloc(1, sizeof(*packet) + csp_buffer_data_size());
+    uint8_t * plain = malloc(csp_buffer_data_size());
+    if ((packet == NULL) || (plain == NULL)) {
+        free(packet);
+        free(plain);
+        return 1;
+    }
+
+    int errors = 0;
+    printf("%8s %18s %14s %8s\n", "size", "xtea+hmac [nS]", "aead [nS]", "speedup");
+    for (unsigned int s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+
+        const uint16_t size = sizes[s];
+        const unsigned int iterations = 100000;
+
+        if ((size_t)(size + CSP_AEAD_LENGTH) > csp_buffer_data_size()) {
+            continue;
+        }
+        for (uint16_t i = 0; i < size; i++) {
+            plain[i] = rand();
+        }
+
+        /* Round trip, and a modified packet must fail authentication */
+        memcpy(packet->data, plain, size);
+        packet->length = size;
+        packet->id.ext = 0x12345678;
+        if ((csp_aead_encrypt_packet(packet, true) != CSP_ERR_NONE) || (packet->length != (size + CSP_AEAD_LENGTH)) ||
+            (csp_aead_decrypt_packet(packet, true) != CSP_ERR_NONE) || (memcmp(packet->data, plain, size) != 0)) {
+            printf("%8u round trip failed\n", size);
+            errors++;
+            continue;
+        }
+        csp_aead_encrypt_packet(packet, true);
+        packet->id.ext ^= 1;
+        if (csp_aead_decrypt_packet(packet, true) != CSP_ERR_AEAD) {
+            printf("%8u modified packet accepted\n", size);
+            errors++;
+            continue;
+        }
+
+        uint64_t start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            packet->length = size;
+            csp_xtea_encrypt_packet(packet);
+            csp_hmac_append(packet, true);
+        }
+        const double ref_ns = (double)(bench_ns() - start) / iterations;
+
+        start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            packet->length = size;
+            csp_aead_encrypt_packet(packet, true);
+        }
+        const double csp_ns = (double)(bench_ns() - start) / iterations;
+
+        printf("%8u %18.1f %14.1f %7.1fx\n", size, ref_ns, csp_ns, ref_ns / csp_ns);
+    }
+
+    free(plain);
+    free(packet);
+    return errors;
+}
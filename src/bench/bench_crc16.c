@@ -0,0 +1,97 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <csp/interfaces/csp_if_ewc.h>
+
+/* Frame sizes to measure, EWC frames are at most 120 bytes */
+static const uint16_t sizes[] = {8, 32, 64, 120, 1024};
+
+/* Bytewise table CRC16, as in libcsp.so */
+static uint16_t ref_tab[256];
+
+static uint16_t ref_crc16_memory(const uint8_t * data, uint16_t length) {
+    uint16_t crc = 0;
+    while (length--) {
+        crc = (uint16_t)(ref_tab[(crc >> 8) ^ *data++] ^ (crc << 8));
+    }
+    return crc;
+}
+
+int bench_crc16(void) {
+
+    for (unsigned int i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (unsigned int j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+        ref_tab[i] = crc;
+    }
+
+    const uint16_t max_size = sizes[(sizeof(sizes) / sizeof(sizes[0])) - 1];
+    uint8_t * data = malloc(max_size);
+    if (data == NULL) {
+        return 1;
+    }
+    for (uint16_t i = 0; i < max_size; i++) {
+        data[i] = rand();
+    }
+
+    int errors = 0;
+    printf("%8s %14s %14s %8s\n", "size", "table [nS]", "csp [nS]", "speedup");
+    for (unsigned int s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+
+        const uint16_t size = sizes[s];
+        const unsigned int iterations = (16 * 1024 * 1024) / size;
+        volatile uint16_t sink = 0;
+
+        /* Chunked update must match a single pass */
+        uint16_t chunked = 0;
+        for (uint16_t pos = 0; pos < size; pos += 5) {
+            chunked = csp_crc16_update(chunked, data + pos, ((size - pos) < 5) ? (size - pos) : 5);
+        }
+        if ((ref_crc16_memory(data, size) != csp_crc16_memory(data, size)) || (chunked != csp_crc16_memory(data, size))) {
+            printf("%8u mismatch\n", size);
+            errors++;
+            continue;
+        }
+
+        uint64_t start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            sink ^= ref_crc16_memory(data, size);
+        }
+        const double ref_ns = (double)(bench_ns() - start) / iterations;
+
+        start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            sink ^= csp_crc16_memory(data, size);
+        }
+        const double csp_ns = (double)(bench_ns() - start) / iterations;
+
+        printf("%8u %14.1f %14.1f %7.1fx\n", size, ref_ns, csp_ns, ref_ns / csp_ns);
+    }
+
+    free(data);
+    return errors;
+}
@@ -0,0 +1,93 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <csp/csp_crc32.h>
+
+/* Packet sizes to measure, 1400 is the configured MTU */
+static const uint32_t sizes[] = {16, 64, 256, 1400, 65536};
+
+/* Bytewise table CRC32-C, as in libcsp.so */
+static uint32_t ref_tab[256];
+
+static uint32_t ref_crc32_memory(const uint8_t * data, uint32_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (length--) {
+        crc = ref_tab[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+int bench_crc32(void) {
+
+    for (unsigned int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (unsigned int j = 0; j < 8; j++) {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+        }
+        ref_tab[i] = crc;
+    }
+
+    const uint32_t max_size = sizes[(sizeof(sizes) / sizeof(sizes[0])) - 1];
+    uint8_t * data = malloc(max_size);
+    if (data == NULL) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < max_size; i++) {
+        data[i] = rand();
+    }
+
+    int errors = 0;
+    printf("%8s %14s %14s %8s\n", "size", "table [nS]", "csp [nS]", "speedup");
+    for (unsigned int s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+
+        const uint32_t size = sizes[s];
+        const unsigned int iterations = (64 * 1024 * 1024) / size;
+        volatile uint32_t sink = 0;
+
+        /* Odd offset, packet data is rarely 8 byte aligned */
+        if (ref_crc32_memory(data + 1, size - 1) != csp_crc32_memory(data + 1, size - 1)) {
+            printf("%8u mismatch\n", size);
+            errors++;
+            continue;
+        }
+
+        uint64_t start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            sink ^= ref_crc32_memory(data, size);
+        }
+        const double ref_ns = (double)(bench_ns() - start) / iterations;
+
+        start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            sink ^= csp_crc32_memory(data, size);
+        }
+        const double csp_ns = (double)(bench_ns() - start) / iterations;
+
+        printf("%8u %14.1f %14.1f %7.1fx\n", size, ref_ns, csp_ns, ref_ns / csp_ns);
+    }
+
+    free(data);
+    return errors;
+}
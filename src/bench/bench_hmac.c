@@ -0,0 +1,86 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/crypto/csp_hmac.h>
+
+/* Packet sizes to measure */
+static const uint16_t sizes[] = {16, 64, 200};
+
+int bench_hmac(void) {
+
+    const uint8_t key[] = "bench key";
+    uint8_t hash[CSP_SHA1_DIGESTSIZE];
+    csp_sha1_memory(key, sizeof(key), hash);
+    csp_hmac_set_key(key, sizeof(key));
+
+    csp_packet_t * packet = calloc(1, sizeof(*packet) + csp_buffer_data_size());
+    if (packet == NULL) {
+        return 1;
+    }
+
+    int errors = 0;
+    printf("%8s %14s %14s %8s\n", "size", "memory [nS]", "append [nS]", "speedup");
+    for (unsigned int s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+
+        const uint16_t size = sizes[s];
+        const unsigned int iterations = 200000;
+        uint8_t hmac[CSP_SHA1_DIGESTSIZE];
+
+        for (uint16_t i = 0; i < size; i++) {
+            packet->data[i] = rand();
+        }
+
+        /* Cached midstate must give the same HMAC as the full calculation */
+        packet->length = size;
+        csp_hmac_memory(hash, 16, packet->data, size, hmac);
+        if ((csp_hmac_append(packet, false) != CSP_ERR_NONE) || (memcmp(&packet->data[size], hmac, CSP_HMAC_LENGTH) != 0) ||
+            (csp_hmac_verify(packet, false) != CSP_ERR_NONE)) {
+            printf("%8u mismatch\n", size);
+            errors++;
+            continue;
+        }
+
+        uint64_t start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            csp_hmac_memory(hash, 16, packet->data, size, hmac);
+        }
+        const double ref_ns = (double)(bench_ns() - start) / iterations;
+
+        start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            packet->length = size;
+            csp_hmac_append(packet, false);
+        }
+        const double csp_ns = (double)(bench_ns() - start) / iterations;
+
+        printf("%8u %14.1f %14.1f %7.1fx\n", size, ref_ns, csp_ns, ref_ns / csp_ns);
+    }
+
+    free(packet);
+    return errors;
+}
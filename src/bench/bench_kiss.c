@@ -0,0 +1,204 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csp/csp_crc32.h>
+#include <csp/csp_endian.h>
+#include <csp/interfaces/csp_if_kiss.h>
+
+#define FEND		0xC0
+#define FESC		0xDB
+#define TFEND		0xDC
+#define TFESC		0xDD
+
+/* Frame sizes to measure (unescaped) */
+static const uint16_t sizes[] = {64, 256, 1024};
+
+/* Max unescaped frame length */
+#define BENCH_KISS_MAX_RX	1100
+
+/* Bytes per csp_kiss_rx() call, as the Linux USART driver */
+#define BENCH_KISS_CHUNK	400
+
+/* Bytes of KISS frames per run */
+#define BENCH_KISS_STREAM	(1024 * 1024)
+
+/* Bytewise state machine, as in libcsp.so */
+static void ref_kiss_rx(csp_iface_t * iface, const uint8_t * buf, size_t len) {
+
+    csp_kiss_interface_data_t * ifdata = iface->interface_data;
+    while (len--) {
+        uint8_t inputbyte = *buf++;
+        if (ifdata->rx_length > ifdata->max_rx_length) {
+            iface->rx_error++;
+            ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+            ifdata->rx_length = 0;
+        }
+        switch (ifdata->rx_mode) {
+            case KISS_MODE_NOT_STARTED:
+                if (inputbyte == FEND) {
+                    ifdata->rx_length = 0;
+                    ifdata->rx_mode = KISS_MODE_STARTED;
+                    ifdata->rx_first = true;
+                }
+                break;
+            case KISS_MODE_STARTED:
+                if (inputbyte == FESC) {
+                    ifdata->rx_mode = KISS_MODE_ESCAPED;
+                    break;
+                }
+                if (inputbyte == FEND) {
+                    if (ifdata->rx_length > 0) {
+                        if (ifdata->rx_length < CSP_HEADER_LENGTH + sizeof(uint32_t)) {
+                            iface->rx_error++;
+                            ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+                            break;
+                        }
+                        iface->frame++;
+                        ifdata->rx_packet->length = ifdata->rx_length - CSP_HEADER_LENGTH;
+                        ifdata->rx_packet->id.ext = csp_ntoh32(ifdata->rx_packet->id.ext);
+                        /* Random data never has a valid CRC, so the packet stays with the deframer */
+                        if (csp_crc32_verify(ifdata->rx_packet, false) != CSP_ERR_NONE) {
+                            iface->rx_error++;
+                        }
+                        ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+                    }
+                    break;
+                }
+                if (ifdata->rx_first) {
+                    ifdata->rx_first = false;
+                    break;
+                }
+                ((uint8_t *) &ifdata->rx_packet->id.ext)[ifdata->rx_length++] = inputbyte;
+                break;
+            case KISS_MODE_ESCAPED:
+                if (inputbyte == TFESC) {
+                    ((uint8_t *) &ifdata->rx_packet->id.ext)[ifdata->rx_length++] = FESC;
+                }
+                if (inputbyte == TFEND) {
+                    ((uint8_t *) &ifdata->rx_packet->id.ext)[ifdata->rx_length++] = FEND;
+                }
+                ifdata->rx_mode = KISS_MODE_STARTED;
+                break;
+            case KISS_MODE_SKIP_FRAME:
+                if (inputbyte == FEND) {
+                    ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+                }
+                break;
+        }
+    }
+}
+
+/* Build a stream of KISS frames with random data, returns the stream length */
+static size_t make_stream(uint8_t * stream, size_t max, uint16_t size) {
+
+    size_t pos = 0;
+    while ((pos + (2 * size) + 3) <= max) {
+        stream[pos++] = FEND;
+        stream[pos++] = 0x00; // TNC_DATA
+        for (uint16_t i = 0; i < size; i++) {
+            const uint8_t b = rand();
+            if (b == FEND) {
+                stream[pos++] = FESC;
+                stream[pos++] = TFEND;
+            } else if (b == FESC) {
+                stream[pos++] = FESC;
+                stream[pos++] = TFESC;
+            } else {
+                stream[pos++] = b;
+            }
+        }
+        stream[pos++] = FEND;
+    }
+    return pos;
+}
+
+static void setup(csp_iface_t * iface, csp_kiss_interface_data_t * ifdata, csp_packet_t * packet) {
+
+    memset(iface, 0, sizeof(*iface));
+    memset(ifdata, 0, sizeof(*ifdata));
+    ifdata->max_rx_length = BENCH_KISS_MAX_RX;
+    ifdata->rx_packet = packet;
+    iface->interface_data = ifdata;
+}
+
+int bench_kiss(void) {
+
+    uint8_t * stream = malloc(BENCH_KISS_STREAM);
+    csp_packet_t * ref_packet = calloc(1, sizeof(csp_packet_t) + BENCH_KISS_MAX_RX + 1);
+    csp_packet_t * csp_packet = calloc(1, sizeof(csp_packet_t) + BENCH_KISS_MAX_RX + 1);
+    if ((stream == NULL) || (ref_packet == NULL) || (csp_packet == NULL)) {
+        free(stream);
+        free(ref_packet);
+        free(csp_packet);
+        return 1;
+    }
+
+    int errors = 0;
+    printf("%8s %14s %14s %8s\n", "size", "bytewise [nS]", "csp [nS]", "speedup");
+    for (unsigned int s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+
+        const uint16_t size = sizes[s];
+        const size_t length = make_stream(stream, BENCH_KISS_STREAM, size);
+        const unsigned int iterations = 10;
+
+        csp_iface_t ref_iface, csp_iface;
+        csp_kiss_interface_data_t ref_ifdata, csp_ifdata;
+
+        uint64_t start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            setup(&ref_iface, &ref_ifdata, ref_packet);
+            for (size_t pos = 0; pos < length; pos += BENCH_KISS_CHUNK) {
+                ref_kiss_rx(&ref_iface, stream + pos, ((length - pos) < BENCH_KISS_CHUNK) ? (length - pos) : BENCH_KISS_CHUNK);
+            }
+        }
+        const double ref_ns = (double)(bench_ns() - start) / ((double) iterations * ref_iface.frame);
+
+        start = bench_ns();
+        for (unsigned int i = 0; i < iterations; i++) {
+            setup(&csp_iface, &csp_ifdata, csp_packet);
+            for (size_t pos = 0; pos < length; pos += BENCH_KISS_CHUNK) {
+                csp_kiss_rx(&csp_iface, stream + pos, ((length - pos) < BENCH_KISS_CHUNK) ? (length - pos) : BENCH_KISS_CHUNK, NULL);
+            }
+        }
+        const double csp_ns = (double)(bench_ns() - start) / ((double) iterations * csp_iface.frame);
+
+        /* Same frames, errors and last frame data */
+        if ((ref_iface.frame != csp_iface.frame) || (ref_iface.rx_error != csp_iface.rx_error) ||
+            (ref_ifdata.rx_length != csp_ifdata.rx_length) ||
+            (memcmp(&ref_packet->id, &csp_packet->id, ref_ifdata.rx_length) != 0)) {
+            printf("%8u mismatch\n", size);
+            errors++;
+            continue;
+        }
+
+        printf("%8u %14.1f %14.1f %7.1fx\n", size, ref_ns, csp_ns, ref_ns / csp_ns);
+    }
+
+    free(stream);
+    free(ref_packet);
+    free(csp_packet);
+    return errors;
+}
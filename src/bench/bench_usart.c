@@ -0,0 +1,193 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // posix_openpt(), ptsname()
+#endif
+
+#include "bench.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <csp/drivers/usart.h>
+
+/* Frame size, the last byte is the frame terminator */
+#define BENCH_USART_FRAME	64
+#define BENCH_USART_END		0xC0
+
+/* Send time, 7 bits per byte so it never contains the terminator */
+#define BENCH_USART_STAMP	10
+
+/* Frames for throughput and latency runs */
+#define BENCH_USART_FRAMES	20000
+#define BENCH_USART_PINGS	2000
+
+/* Max time to wait for frames, nS */
+#define BENCH_USART_TIMEOUT	(5 * 1000000000ULL)
+
+typedef struct {
+    const char * name;
+    csp_usart_conf_t conf;
+} bench_usart_config_t;
+
+/* Configurations to measure, device is set to the pty */
+static const bench_usart_config_t configs[] = {
+    {"default",    {.baudrate = 115200}},
+    {"vmin=64",    {.baudrate = 115200, .vmin = BENCH_USART_FRAME, .vtime = 1}},
+    {"chunk=4096", {.baudrate = 115200, .rx_chunk_size = 4096}},
+    {"gap=200uS",  {.baudrate = 115200, .rx_chunk_size = 4096, .rx_gap_us = 200}},
+};
+
+typedef struct {
+    /* Bytes of current frame, starting with the send time */
+    uint8_t frame[BENCH_USART_FRAME];
+    unsigned int pos;
+    /* Received frames, and latency of the last frame */
+    unsigned int frames;
+    uint64_t latency;
+    unsigned int callbacks;
+} bench_usart_state_t;
+
+static void bench_usart_rx(void * user_data, uint8_t * buf, size_t len, void * pxTaskWoken) {
+
+    bench_usart_state_t * state = user_data;
+    state->callbacks++;
+    for (size_t i = 0; i < len; i++) {
+        if (state->pos < BENCH_USART_FRAME) {
+            state->frame[state->pos++] = buf[i];
+        }
+        if (buf[i] == BENCH_USART_END) {
+            uint64_t sent = 0;
+            for (unsigned int b = 0; b < BENCH_USART_STAMP; b++) {
+                sent |= (uint64_t)(state->frame[b] & 0x7F) << (7 * b);
+            }
+            state->latency = bench_ns() - sent;
+            state->pos = 0;
+            __atomic_store_n(&state->frames, state->frames + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* Send a frame stamped with the current time */
+static int bench_usart_send(int fd) {
+
+    uint8_t frame[BENCH_USART_FRAME];
+    memset(frame, 0x55, sizeof(frame));
+    const uint64_t now = bench_ns();
+    for (unsigned int b = 0; b < BENCH_USART_STAMP; b++) {
+        frame[b] = (uint8_t)((now >> (7 * b)) & 0x7F);
+    }
+    frame[BENCH_USART_FRAME - 1] = BENCH_USART_END;
+    return (write(fd, frame, sizeof(frame)) == sizeof(frame)) ? 0 : -1;
+}
+
+/* Wait until \a frames have been received */
+static int bench_usart_wait(bench_usart_state_t * state, unsigned int frames) {
+
+    const uint64_t start = bench_ns();
+    while (__atomic_load_n(&state->frames, __ATOMIC_ACQUIRE) < frames) {
+        if ((bench_ns() - start) > BENCH_USART_TIMEOUT) {
+            return -1;
+        }
+        sched_yield();
+    }
+    return 0;
+}
+
+static int compare_u64(const void * a, const void * b) {
+    const uint64_t x = *(const uint64_t *) a;
+    const uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int bench_usart(void) {
+
+    uint64_t * latency = malloc(BENCH_USART_PINGS * sizeof(*latency));
+    if (latency == NULL) {
+        return 1;
+    }
+
+    int errors = 0;
+    printf("%12s %14s %14s %14s %14s\n", "config", "frames/s", "bytes/callback", "latency [uS]", "p99 [uS]");
+    for (unsigned int c = 0; c < (sizeof(configs) / sizeof(configs[0])); c++) {
+
+        /* The master end stays open - the Rx thread keeps the slave end until exit */
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+            printf("%12s failed to open pty\n", configs[c].name);
+            return 1;
+        }
+
+        bench_usart_state_t * state = calloc(1, sizeof(*state));
+        csp_usart_conf_t conf = configs[c].conf;
+        conf.device = ptsname(master);
+        csp_usart_fd_t fd;
+        if ((state == NULL) || (csp_usart_open(&conf, bench_usart_rx, state, &fd) != CSP_ERR_NONE)) {
+            printf("%12s failed to open %s\n", configs[c].name, conf.device);
+            errors++;
+            continue;
+        }
+
+        /* Throughput: back-to-back frames */
+        uint64_t start = bench_ns();
+        for (unsigned int i = 0; i < BENCH_USART_FRAMES; i++) {
+            if (bench_usart_send(master) != 0) {
+                break;
+            }
+        }
+        if (bench_usart_wait(state, BENCH_USART_FRAMES) != 0) {
+            printf("%12s lost frames: %u of %u\n", configs[c].name, BENCH_USART_FRAMES - state->frames, BENCH_USART_FRAMES);
+            errors++;
+            continue;
+        }
+        const double fps = BENCH_USART_FRAMES / ((double)(bench_ns() - start) / 1e9);
+        const double per_callback = ((double) BENCH_USART_FRAMES * BENCH_USART_FRAME) / state->callbacks;
+
+        /* Latency: one frame at a time */
+        unsigned int pings = 0;
+        for (; pings < BENCH_USART_PINGS; pings++) {
+            if ((bench_usart_send(master) != 0) || (bench_usart_wait(state, BENCH_USART_FRAMES + pings + 1) != 0)) {
+                break;
+            }
+            latency[pings] = state->latency;
+        }
+        if (pings < BENCH_USART_PINGS) {
+            printf("%12s lost ping %u\n", configs[c].name, pings);
+            errors++;
+            continue;
+        }
+        uint64_t sum = 0;
+        for (unsigned int i = 0; i < pings; i++) {
+            sum += latency[i];
+        }
+        qsort(latency, pings, sizeof(*latency), compare_u64);
+
+        printf("%12s %14.0f %14.1f %14.1f %14.1f\n", configs[c].name, fps, per_callback,
+               (sum / (double) pings) / 1e3, latency[(pings * 99) / 100] / 1e3);
+    }
+
+    free(latency);
+    return errors;
+}
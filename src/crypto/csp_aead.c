@@ -0,0 +1,646 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*
+   ChaCha20-Poly1305 AEAD (RFC 8439).
+
+   Encryption and authentication are done in one pass: the data is processed in chunks of 8 ChaCha20 blocks (512 bytes), and
+   each chunk is XORed with the keystream and fed to Poly1305 while still in L1 cache. Decryption authenticates all of the
+   ciphertext first, and only decrypts it if the tag matches - so unauthenticated plaintext is never returned.
+
+   The keystream blocks are calculated in parallel, one block per 32 bit lane: 8 blocks with AVX2 (selected at startup),
+   otherwise 4 blocks with SSE2 on x86-64 or NEON on ARMv8 (only if built with CSP_ARM_ACCEL). The Poly1305 key (block 0) is
+   calculated together with the first data blocks.
+
+   ChaCha20 is used rather than AES-GCM, as it is fast without AES instructions, which are optional on ARMv8.
+*/
+
+#include <csp/crypto/csp_aead.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_endian.h>
+#include <csp/crypto/csp_sha1.h>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+#include <arm_neon.h>
+#endif
+
+/** ChaCha20 block size in bytes */
+#define CSP_CHACHA20_BLOCKSIZE	64
+
+/** Keystream blocks per chunk */
+#define CSP_AEAD_CHUNK_BLOCKS	8
+
+/** Poly1305 block size in bytes */
+#define CSP_POLY1305_BLOCKSIZE	16
+
+#define CSP_POLY1305_MASK44	0xfffffffffffULL
+#define CSP_POLY1305_MASK42	0x3ffffffffffULL
+
+/**
+   Poly1305 state, 44/44/42 bit limbs.
+*/
+typedef struct {
+	uint64_t r[3];
+	uint64_t h[3];
+	uint64_t pad[2];
+} csp_poly1305_t;
+
+/** ChaCha20 key, set by csp_aead_set_key() */
+static uint32_t csp_aead_key[8];
+
+/** Next packet nonce, starts at a random value */
+static uint64_t csp_aead_nonce;
+
+static inline uint32_t csp_aead_load32le(const uint8_t * p) {
+	return ((uint32_t) p[0]) | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t csp_aead_load64le(const uint8_t * p) {
+	return ((uint64_t) csp_aead_load32le(p)) | ((uint64_t) csp_aead_load32le(p + 4) << 32);
+}
+
+static inline void csp_aead_store32le(uint8_t * p, uint32_t v) {
+	p[0] = (uint8_t) v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void csp_aead_store64le(uint8_t * p, uint64_t v) {
+	csp_aead_store32le(p, (uint32_t) v);
+	csp_aead_store32le(p + 4, (uint32_t)(v >> 32));
+}
+
+/* ChaCha20 */
+
+#define CSP_CHACHA20_ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define CSP_CHACHA20_QR(a, b, c, d)					\
+	a += b; d ^= a; d = CSP_CHACHA20_ROL(d, 16);			\
+	c += d; b ^= c; b = CSP_CHACHA20_ROL(b, 12);			\
+	a += b; d ^= a; d = CSP_CHACHA20_ROL(d, 8);			\
+	c += d; b ^= c; b = CSP_CHACHA20_ROL(b, 7)
+
+static inline void csp_chacha20_init(uint32_t x[16], uint32_t counter, const uint32_t nonce[3]) {
+
+	x[0] = 0x61707865;
+	x[1] = 0x3320646e;
+	x[2] = 0x79622d32;
+	x[3] = 0x6b206574;
+	memcpy(&x[4], csp_aead_key, sizeof(csp_aead_key));
+	x[12] = counter;
+	x[13] = nonce[0];
+	x[14] = nonce[1];
+	x[15] = nonce[2];
+}
+
+/**
+   Calculate \a blocks keystream blocks, starting at block \a counter.
+*/
+static void csp_chacha20_blocks_sw(uint32_t counter, const uint32_t nonce[3], uint8_t * out, unsigned int blocks) {
+
+	for (; blocks; --blocks, ++counter, out += CSP_CHACHA20_BLOCKSIZE) {
+		uint32_t in[16], x[16];
+		csp_chacha20_init(in, counter, nonce);
+		memcpy(x, in, sizeof(x));
+		for (unsigned int i = 0; i < 10; i++) {
+			CSP_CHACHA20_QR(x[0], x[4], x[8], x[12]);
+			CSP_CHACHA20_QR(x[1], x[5], x[9], x[13]);
+			CSP_CHACHA20_QR(x[2], x[6], x[10], x[14]);
+			CSP_CHACHA20_QR(x[3], x[7], x[11], x[15]);
+			CSP_CHACHA20_QR(x[0], x[5], x[10], x[15]);
+			CSP_CHACHA20_QR(x[1], x[6], x[11], x[12]);
+			CSP_CHACHA20_QR(x[2], x[7], x[8], x[13]);
+			CSP_CHACHA20_QR(x[3], x[4], x[9], x[14]);
+		}
+		for (unsigned int i = 0; i < 16; i++) {
+			csp_aead_store32le(out + (4 * i), x[i] + in[i]);
+		}
+	}
+}
+
+#if defined(__x86_64__)
+
+#define CSP_CHACHA20_ROL4(x, n)	_mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+#define CSP_CHACHA20_QR4(a, b, c, d)									\
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CSP_CHACHA20_ROL4(d, 16);		\
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CSP_CHACHA20_ROL4(b, 12);		\
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CSP_CHACHA20_ROL4(d, 8);		\
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CSP_CHACHA20_ROL4(b, 7)
+
+/* 4 blocks, one per lane */
+static void csp_chacha20_blocks4(uint32_t counter, const uint32_t nonce[3], uint8_t * out) {
+
+	uint32_t in[16];
+	csp_chacha20_init(in, counter, nonce);
+
+	__m128i s[16], x[16];
+	for (unsigned int i = 0; i < 16; i++) {
+		s[i] = _mm_set1_epi32((int) in[i]);
+	}
+	s[12] = _mm_add_epi32(s[12], _mm_setr_epi32(0, 1, 2, 3));
+	memcpy(x, s, sizeof(x));
+
+	for (unsigned int i = 0; i < 10; i++) {
+		CSP_CHACHA20_QR4(x[0], x[4], x[8], x[12]);
+		CSP_CHACHA20_QR4(x[1], x[5], x[9], x[13]);
+		CSP_CHACHA20_QR4(x[2], x[6], x[10], x[14]);
+		CSP_CHACHA20_QR4(x[3], x[7], x[11], x[15]);
+		CSP_CHACHA20_QR4(x[0], x[5], x[10], x[15]);
+		CSP_CHACHA20_QR4(x[1], x[6], x[11], x[12]);
+		CSP_CHACHA20_QR4(x[2], x[7], x[8], x[13]);
+		CSP_CHACHA20_QR4(x[3], x[4], x[9], x[14]);
+	}
+
+	/* Transpose 4x4 words: lane b of x[w..w+3] is word w..w+3 of block b */
+	for (unsigned int w = 0; w < 16; w += 4) {
+		const __m128i a = _mm_add_epi32(x[w + 0], s[w + 0]);
+		const __m128i b = _mm_add_epi32(x[w + 1], s[w + 1]);
+		const __m128i c = _mm_add_epi32(x[w + 2], s[w + 2]);
+		const __m128i d = _mm_add_epi32(x[w + 3], s[w + 3]);
+		const __m128i t0 = _mm_unpacklo_epi32(a, b);
+		const __m128i t1 = _mm_unpacklo_epi32(c, d);
+		const __m128i t2 = _mm_unpackhi_epi32(a, b);
+		const __m128i t3 = _mm_unpackhi_epi32(c, d);
+		_mm_storeu_si128((__m128i *)(out + (0 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128((__m128i *)(out + (1 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128((__m128i *)(out + (2 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128((__m128i *)(out + (3 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), _mm_unpackhi_epi64(t2, t3));
+	}
+}
+
+#elif defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+
+#define CSP_CHACHA20_ROL4(x, n)	vsriq_n_u32(vshlq_n_u32((x), (n)), (x), 32 - (n))
+
+#define CSP_CHACHA20_QR4(a, b, c, d)								\
+	a = vaddq_u32(a, b); d = veorq_u32(d, a); d = CSP_CHACHA20_ROL4(d, 16);		\
+	c = vaddq_u32(c, d); b = veorq_u32(b, c); b = CSP_CHACHA20_ROL4(b, 12);		\
+	a = vaddq_u32(a, b); d = veorq_u32(d, a); d = CSP_CHACHA20_ROL4(d, 8);		\
+	c = vaddq_u32(c, d); b = veorq_u32(b, c); b = CSP_CHACHA20_ROL4(b, 7)
+
+/* 4 blocks, one per lane */
+static void csp_chacha20_blocks4(uint32_t counter, const uint32_t nonce[3], uint8_t * out) {
+
+	static const uint32_t lane[4] = {0, 1, 2, 3};
+	uint32_t in[16];
+	csp_chacha20_init(in, counter, nonce);
+
+	uint32x4_t s[16], x[16];
+	for (unsigned int i = 0; i < 16; i++) {
+		s[i] = vdupq_n_u32(in[i]);
+	}
+	s[12] = vaddq_u32(s[12], vld1q_u32(lane));
+	memcpy(x, s, sizeof(x));
+
+	for (unsigned int i = 0; i < 10; i++) {
+		CSP_CHACHA20_QR4(x[0], x[4], x[8], x[12]);
+		CSP_CHACHA20_QR4(x[1], x[5], x[9], x[13]);
+		CSP_CHACHA20_QR4(x[2], x[6], x[10], x[14]);
+		CSP_CHACHA20_QR4(x[3], x[7], x[11], x[15]);
+		CSP_CHACHA20_QR4(x[0], x[5], x[10], x[15]);
+		CSP_CHACHA20_QR4(x[1], x[6], x[11], x[12]);
+		CSP_CHACHA20_QR4(x[2], x[7], x[8], x[13]);
+		CSP_CHACHA20_QR4(x[3], x[4], x[9], x[14]);
+	}
+
+	/* Transpose 4x4 words: lane b of x[w..w+3] is word w..w+3 of block b */
+	for (unsigned int w = 0; w < 16; w += 4) {
+		const uint32x4x2_t ab = vtrnq_u32(vaddq_u32(x[w + 0], s[w + 0]), vaddq_u32(x[w + 1], s[w + 1]));
+		const uint32x4x2_t cd = vtrnq_u32(vaddq_u32(x[w + 2], s[w + 2]), vaddq_u32(x[w + 3], s[w + 3]));
+		vst1q_u32((uint32_t *)(out + (0 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), vcombine_u32(vget_low_u32(ab.val[0]), vget_low_u32(cd.val[0])));
+		vst1q_u32((uint32_t *)(out + (1 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), vcombine_u32(vget_low_u32(ab.val[1]), vget_low_u32(cd.val[1])));
+		vst1q_u32((uint32_t *)(out + (2 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), vcombine_u32(vget_high_u32(ab.val[0]), vget_high_u32(cd.val[0])));
+		vst1q_u32((uint32_t *)(out + (3 * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), vcombine_u32(vget_high_u32(ab.val[1]), vget_high_u32(cd.val[1])));
+	}
+}
+
+#endif
+
+#if defined(__x86_64__)
+
+/** AVX2 available, set by csp_aead_init() */
+static bool csp_chacha20_avx2;
+
+#define CSP_CHACHA20_ROL8(x, n)	_mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+
+/* Rotations by 16 and 8 are byte shuffles */
+#define CSP_CHACHA20_QR8(a, b, c, d)										\
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); 		\
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CSP_CHACHA20_ROL8(b, 12);		\
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);		\
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CSP_CHACHA20_ROL8(b, 7)
+
+/* 8 blocks, one per lane */
+__attribute__((target("avx2")))
+static void csp_chacha20_blocks8_avx2(uint32_t counter, const uint32_t nonce[3], uint8_t * out) {
+
+	const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+	                                       2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+	                                      3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+	uint32_t in[16];
+	csp_chacha20_init(in, counter, nonce);
+
+	__m256i s[16], x[16];
+	for (unsigned int i = 0; i < 16; i++) {
+		s[i] = _mm256_set1_epi32((int) in[i]);
+	}
+	s[12] = _mm256_add_epi32(s[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	memcpy(x, s, sizeof(x));
+
+	for (unsigned int i = 0; i < 10; i++) {
+		CSP_CHACHA20_QR8(x[0], x[4], x[8], x[12]);
+		CSP_CHACHA20_QR8(x[1], x[5], x[9], x[13]);
+		CSP_CHACHA20_QR8(x[2], x[6], x[10], x[14]);
+		CSP_CHACHA20_QR8(x[3], x[7], x[11], x[15]);
+		CSP_CHACHA20_QR8(x[0], x[5], x[10], x[15]);
+		CSP_CHACHA20_QR8(x[1], x[6], x[11], x[12]);
+		CSP_CHACHA20_QR8(x[2], x[7], x[8], x[13]);
+		CSP_CHACHA20_QR8(x[3], x[4], x[9], x[14]);
+	}
+
+	for (unsigned int i = 0; i < 16; i++) {
+		x[i] = _mm256_add_epi32(x[i], s[i]);
+	}
+
+	/* Transpose 8x8 words: 4x4 within each 128 bit half, then combine halves. Lane b of x[w..w+7] is word w..w+7 of block b */
+	for (unsigned int w = 0; w < 16; w += 8) {
+		__m256i t[8];
+		for (unsigned int h = 0; h < 8; h += 4) {
+			const __m256i t0 = _mm256_unpacklo_epi32(x[w + h + 0], x[w + h + 1]);
+			const __m256i t1 = _mm256_unpacklo_epi32(x[w + h + 2], x[w + h + 3]);
+			const __m256i t2 = _mm256_unpackhi_epi32(x[w + h + 0], x[w + h + 1]);
+			const __m256i t3 = _mm256_unpackhi_epi32(x[w + h + 2], x[w + h + 3]);
+			t[h + 0] = _mm256_unpacklo_epi64(t0, t1);
+			t[h + 1] = _mm256_unpackhi_epi64(t0, t1);
+			t[h + 2] = _mm256_unpacklo_epi64(t2, t3);
+			t[h + 3] = _mm256_unpackhi_epi64(t2, t3);
+		}
+		for (unsigned int b = 0; b < 4; b++) {
+			_mm256_storeu_si256((__m256i *)(out + (b * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), _mm256_permute2x128_si256(t[b], t[b + 4], 0x20));
+			_mm256_storeu_si256((__m256i *)(out + ((b + 4) * CSP_CHACHA20_BLOCKSIZE) + (4 * w)), _mm256_permute2x128_si256(t[b], t[b + 4], 0x31));
+		}
+	}
+}
+
+__attribute__((constructor))
+static void csp_aead_init(void) {
+
+	__builtin_cpu_init();
+	csp_chacha20_avx2 = __builtin_cpu_supports("avx2");
+}
+
+#endif // __x86_64__
+
+/**
+   Calculate \a blocks keystream blocks (max #CSP_AEAD_CHUNK_BLOCKS), starting at block \a counter.
+   Up to #CSP_AEAD_CHUNK_BLOCKS blocks may be written to \a out.
+*/
+static void csp_chacha20_blocks(uint32_t counter, const uint32_t nonce[3], uint8_t * out, unsigned int blocks) {
+
+#if defined(__x86_64__)
+	if (csp_chacha20_avx2 && (blocks > 4)) {
+		csp_chacha20_blocks8_avx2(counter, nonce, out);
+		return;
+	}
+#endif
+#if (defined(__x86_64__) || (defined(__aarch64__) && defined(CSP_ARM_ACCEL))) && (CSP_LITTLE_ENDIAN)
+	/* A partial set of 4 is still faster than 2 scalar blocks */
+	for (; blocks > 1; blocks = (blocks > 4) ? (blocks - 4) : 0) {
+		csp_chacha20_blocks4(counter, nonce, out);
+		counter += 4;
+		out += 4 * CSP_CHACHA20_BLOCKSIZE;
+	}
+#endif
+	csp_chacha20_blocks_sw(counter, nonce, out, blocks);
+}
+
+/* Poly1305 (based on poly1305-donna, 64 bit) */
+
+static void csp_poly1305_init(csp_poly1305_t * st, const uint8_t key[32]) {
+
+	const uint64_t t0 = csp_aead_load64le(key);
+	const uint64_t t1 = csp_aead_load64le(key + 8);
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	st->r[0] = t0 & 0xffc0fffffffULL;
+	st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+	st->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+
+	st->pad[0] = csp_aead_load64le(key + 16);
+	st->pad[1] = csp_aead_load64le(key + 24);
+}
+
+/**
+   Process \a len bytes, a multiple of #CSP_POLY1305_BLOCKSIZE.
+*/
+static void csp_poly1305_blocks(csp_poly1305_t * st, const uint8_t * m, size_t len) {
+
+	const uint64_t hibit = (uint64_t) 1 << 40;
+	const uint64_t r0 = st->r[0];
+	const uint64_t r1 = st->r[1];
+	const uint64_t r2 = st->r[2];
+	const uint64_t s1 = r1 * (5 << 2);
+	const uint64_t s2 = r2 * (5 << 2);
+	uint64_t h0 = st->h[0];
+	uint64_t h1 = st->h[1];
+	uint64_t h2 = st->h[2];
+
+	for (; len >= CSP_POLY1305_BLOCKSIZE; len -= CSP_POLY1305_BLOCKSIZE, m += CSP_POLY1305_BLOCKSIZE) {
+
+		const uint64_t t0 = csp_aead_load64le(m);
+		const uint64_t t1 = csp_aead_load64le(m + 8);
+
+		h0 += t0 & CSP_POLY1305_MASK44;
+		h1 += ((t0 >> 44) | (t1 << 20)) & CSP_POLY1305_MASK44;
+		h2 += ((t1 >> 24) & CSP_POLY1305_MASK42) | hibit;
+
+		/* h *= r */
+		unsigned __int128 d0 = ((unsigned __int128) h0 * r0) + ((unsigned __int128) h1 * s2) + ((unsigned __int128) h2 * s1);
+		unsigned __int128 d1 = ((unsigned __int128) h0 * r1) + ((unsigned __int128) h1 * r0) + ((unsigned __int128) h2 * s2);
+		unsigned __int128 d2 = ((unsigned __int128) h0 * r2) + ((unsigned __int128) h1 * r1) + ((unsigned __int128) h2 * r0);
+
+		/* (partial) h %= p */
+		uint64_t c = (uint64_t)(d0 >> 44);
+		h0 = (uint64_t) d0 & CSP_POLY1305_MASK44;
+		d1 += c;
+		c = (uint64_t)(d1 >> 44);
+		h1 = (uint64_t) d1 & CSP_POLY1305_MASK44;
+		d2 += c;
+		c = (uint64_t)(d2 >> 42);
+		h2 = (uint64_t) d2 & CSP_POLY1305_MASK42;
+		h0 += c * 5;
+		c = h0 >> 44;
+		h0 &= CSP_POLY1305_MASK44;
+		h1 += c;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+}
+
+/**
+   Process \a len bytes, zero padded to a multiple of #CSP_POLY1305_BLOCKSIZE (as in RFC 8439 AEAD construction).
+*/
+static void csp_poly1305_update_padded(csp_poly1305_t * st, const uint8_t * m, size_t len) {
+
+	const size_t full = len & ~(size_t)(CSP_POLY1305_BLOCKSIZE - 1);
+	csp_poly1305_blocks(st, m, full);
+	if (len > full) {
+		uint8_t block[CSP_POLY1305_BLOCKSIZE];
+		memset(block, 0, sizeof(block));
+		memcpy(block, m + full, len - full);
+		csp_poly1305_blocks(st, block, sizeof(block));
+	}
+}
+
+static void csp_poly1305_finish(csp_poly1305_t * st, uint8_t mac[16]) {
+
+	uint64_t h0 = st->h[0];
+	uint64_t h1 = st->h[1];
+	uint64_t h2 = st->h[2];
+	uint64_t c;
+
+	/* fully carry h */
+	c = h1 >> 44; h1 &= CSP_POLY1305_MASK44;
+	h2 += c; c = h2 >> 42; h2 &= CSP_POLY1305_MASK42;
+	h0 += c * 5; c = h0 >> 44; h0 &= CSP_POLY1305_MASK44;
+	h1 += c; c = h1 >> 44; h1 &= CSP_POLY1305_MASK44;
+	h2 += c; c = h2 >> 42; h2 &= CSP_POLY1305_MASK42;
+	h0 += c * 5; c = h0 >> 44; h0 &= CSP_POLY1305_MASK44;
+	h1 += c;
+
+	/* compute h + -p */
+	uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= CSP_POLY1305_MASK44;
+	uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= CSP_POLY1305_MASK44;
+	uint64_t g2 = h2 + c - ((uint64_t) 1 << 42);
+
+	/* select h if h < p, or h + -p if h >= p */
+	c = (g2 >> 63) - 1;
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = (h0 & c) | g0;
+	h1 = (h1 & c) | g1;
+	h2 = (h2 & c) | g2;
+
+	/* h = (h + pad) */
+	const uint64_t t0 = st->pad[0];
+	const uint64_t t1 = st->pad[1];
+	h0 += t0 & CSP_POLY1305_MASK44; c = h0 >> 44; h0 &= CSP_POLY1305_MASK44;
+	h1 += (((t0 >> 44) | (t1 << 20)) & CSP_POLY1305_MASK44) + c; c = h1 >> 44; h1 &= CSP_POLY1305_MASK44;
+	h2 += ((t1 >> 24) & CSP_POLY1305_MASK42) + c; h2 &= CSP_POLY1305_MASK42;
+
+	/* mac = h % (2^128) */
+	csp_aead_store64le(mac, h0 | (h1 << 44));
+	csp_aead_store64le(mac + 8, (h1 >> 20) | (h2 << 24));
+
+	memset(st, 0, sizeof(*st));
+}
+
+/* AEAD */
+
+/**
+   Authenticate the lengths and calculate the tag.
+*/
+static void csp_aead_finish(csp_poly1305_t * poly, uint32_t aadlen, uint32_t len, uint8_t tag[16]) {
+
+	uint8_t lengths[CSP_POLY1305_BLOCKSIZE];
+	csp_aead_store64le(lengths, aadlen);
+	csp_aead_store64le(lengths + 8, len);
+	csp_poly1305_blocks(poly, lengths, sizeof(lengths));
+	csp_poly1305_finish(poly, tag);
+}
+
+/**
+   Encrypt: single pass over \a data, XOR with keystream and authenticate the ciphertext, \a tag is set.
+   Decrypt: authenticate the ciphertext and compare with \a tag, then XOR with keystream - \a data is unchanged on failure.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_AEAD if decryption failed authentication.
+*/
+static int csp_aead_process(uint8_t * data, uint32_t len, const void * aad, uint32_t aadlen, const uint8_t nonce[12], bool encrypt, uint8_t tag[16]) {
+
+	const uint32_t n[3] = {csp_aead_load32le(nonce), csp_aead_load32le(nonce + 4), csp_aead_load32le(nonce + 8)};
+	uint8_t keystream[CSP_AEAD_CHUNK_BLOCKS * CSP_CHACHA20_BLOCKSIZE];
+
+	/* Poly1305 one-time key from block 0, calculated with the first data blocks */
+	uint32_t chunk = ((len + CSP_CHACHA20_BLOCKSIZE) < sizeof(keystream)) ? len : (sizeof(keystream) - CSP_CHACHA20_BLOCKSIZE);
+	uint32_t counter = 1 + ((chunk + CSP_CHACHA20_BLOCKSIZE - 1) / CSP_CHACHA20_BLOCKSIZE);
+	csp_chacha20_blocks(0, n, keystream, counter);
+	const uint8_t * ks = keystream + CSP_CHACHA20_BLOCKSIZE;
+
+	csp_poly1305_t poly;
+	csp_poly1305_init(&poly, keystream);
+	csp_poly1305_update_padded(&poly, aad, aadlen);
+
+	if (!encrypt) {
+		uint8_t calc[CSP_AEAD_TAG_LENGTH];
+		csp_poly1305_update_padded(&poly, data, len);
+		csp_aead_finish(&poly, aadlen, len, calc);
+
+		/* Constant time compare */
+		uint8_t diff = 0;
+		for (unsigned int i = 0; i < CSP_AEAD_TAG_LENGTH; i++) {
+			diff |= calc[i] ^ tag[i];
+		}
+		if (diff != 0) {
+			return CSP_ERR_AEAD;
+		}
+	}
+
+	for (uint32_t pos = 0; pos < len; ) {
+		if (pos > 0) {
+			chunk = ((len - pos) < sizeof(keystream)) ? (len - pos) : sizeof(keystream);
+			const unsigned int blocks = (chunk + CSP_CHACHA20_BLOCKSIZE - 1) / CSP_CHACHA20_BLOCKSIZE;
+			csp_chacha20_blocks(counter, n, keystream, blocks);
+			counter += blocks;
+			ks = keystream;
+		}
+
+		uint32_t i = 0;
+		for (; (i + sizeof(uint64_t)) <= chunk; i += sizeof(uint64_t)) {
+			uint64_t d, k;
+			memcpy(&d, data + pos + i, sizeof(d));
+			memcpy(&k, ks + i, sizeof(k));
+			d ^= k;
+			memcpy(data + pos + i, &d, sizeof(d));
+		}
+		for (; i < chunk; i++) {
+			data[pos + i] ^= ks[i];
+		}
+		if (encrypt) {
+			/* Authenticate ciphertext while the chunk is in cache */
+			csp_poly1305_update_padded(&poly, data + pos, chunk);
+		}
+
+		pos += chunk;
+	}
+
+	if (encrypt) {
+		csp_aead_finish(&poly, aadlen, len, tag);
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_aead_set_key(const void * key, uint32_t keylen) {
+
+	/* Use SHA1 as KDF: SHA1(1 | key) | SHA1(2 | key) */
+	uint8_t hash[2 * CSP_SHA1_DIGESTSIZE];
+	for (uint8_t i = 0; i < 2; i++) {
+		const uint8_t prefix = i + 1;
+		csp_sha1_state_t state;
+		csp_sha1_init(&state);
+		csp_sha1_process(&state, &prefix, sizeof(prefix));
+		csp_sha1_process(&state, key, keylen);
+		csp_sha1_done(&state, &hash[i * CSP_SHA1_DIGESTSIZE]);
+	}
+	for (unsigned int i = 0; i < 8; i++) {
+		csp_aead_key[i] = csp_aead_load32le(&hash[4 * i]);
+	}
+	memset(hash, 0, sizeof(hash));
+
+	/* Random start of the nonce counter, so nodes sharing the key (or restarting) don't reuse nonces */
+	uint64_t nonce = 0;
+#if defined(__linux__)
+	if (getrandom(&nonce, sizeof(nonce), 0) != sizeof(nonce))
+#endif
+	{
+		nonce = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+	}
+	__atomic_store_n(&csp_aead_nonce, nonce, __ATOMIC_RELAXED);
+
+	return CSP_ERR_NONE;
+}
+
+int csp_aead_encrypt(void * data, uint32_t len, const void * aad, uint32_t aadlen, const uint8_t nonce[12], uint8_t * tag) {
+
+	csp_aead_process(data, len, aad, aadlen, nonce, true, tag);
+
+	return CSP_ERR_NONE;
+}
+
+int csp_aead_decrypt(void * data, uint32_t len, const void * aad, uint32_t aadlen, const uint8_t nonce[12], const uint8_t * tag) {
+
+	uint8_t expected[CSP_AEAD_TAG_LENGTH];
+	memcpy(expected, tag, sizeof(expected));
+
+	return csp_aead_process(data, len, aad, aadlen, nonce, false, expected);
+}
+
+int csp_aead_encrypt_packet(csp_packet_t * packet, bool include_header) {
+
+	/* Check that there is room for nonce and tag */
+	if ((packet->length + (unsigned int)CSP_AEAD_LENGTH) > csp_buffer_data_size()) {
+		return CSP_ERR_NOMEM;
+	}
+
+	uint8_t nonce[12] = {0};
+	csp_aead_store64le(&nonce[4], __atomic_fetch_add(&csp_aead_nonce, 1, __ATOMIC_RELAXED));
+
+	const uint32_t id = csp_hton32(packet->id.ext);
+	uint8_t * trailer = &packet->data[packet->length];
+	csp_aead_process(packet->data, packet->length, &id, include_header ? sizeof(id) : 0, nonce, true, trailer + CSP_AEAD_NONCE_LENGTH);
+	memcpy(trailer, &nonce[4], CSP_AEAD_NONCE_LENGTH);
+	packet->length += CSP_AEAD_LENGTH;
+
+	return CSP_ERR_NONE;
+}
+
+int csp_aead_decrypt_packet(csp_packet_t * packet, bool include_header) {
+
+	if (packet->length < (unsigned int)CSP_AEAD_LENGTH) {
+		return CSP_ERR_AEAD;
+	}
+
+	const uint32_t len = packet->length - CSP_AEAD_LENGTH;
+	uint8_t nonce[12] = {0};
+	memcpy(&nonce[4], &packet->data[len], CSP_AEAD_NONCE_LENGTH);
+
+	const uint32_t id = csp_hton32(packet->id.ext);
+	if (csp_aead_decrypt(packet->data, len, &id, include_header ? sizeof(id) : 0, nonce, &packet->data[len + CSP_AEAD_NONCE_LENGTH]) != CSP_ERR_NONE) {
+		return CSP_ERR_AEAD;
+	}
+
+	/* Strip nonce and tag */
+	packet->length = len;
+
+	return CSP_ERR_NONE;
+}
@@ -0,0 +1,186 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*
+   HMAC-SHA1 for csp_hmac_*().
+
+   The original libcsp.so version feeds the 64 byte ipad/opad blocks through SHA1 for every packet, i.e. 4 compressions for a
+   small packet. Here the SHA1 state after the ipad and opad blocks (midstate) is calculated once in csp_hmac_set_key(), and
+   each packet only costs the compressions for its data and the inner digest - 2 for packets up to 55 bytes.
+
+   libcsp calls these functions through the PLT, so the router uses them as well.
+
+   Packets are verified one at a time: the router in libcsp.so calls csp_hmac_verify() per packet, so there is no burst to hash
+   in parallel (multi-buffer SHA1).
+*/
+
+#include <csp/crypto/csp_hmac.h>
+
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+
+/** Size of the key stored by csp_hmac_set_key(), compatible with libcsp.so */
+#define CSP_HMAC_KEY_LENGTH	16
+
+/**
+   HMAC state after the ipad/opad blocks.
+*/
+typedef struct {
+	//! SHA1 state after processing key ^ ipad.
+	csp_sha1_state_t inner;
+	//! SHA1 state after processing key ^ opad.
+	csp_sha1_state_t outer;
+} csp_hmac_midstate_t;
+
+/** Midstate of the key set by csp_hmac_set_key(), initialized for the default key by csp_hmac_setup() */
+static csp_hmac_midstate_t csp_hmac_key_midstate;
+
+static int csp_hmac_midstate_init(csp_hmac_midstate_t * mid, const void * key, uint32_t keylen) {
+
+	if (keylen == 0) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* Keys longer than the block size are hashed, shorter keys are zero padded */
+	uint8_t block[CSP_SHA1_BLOCKSIZE];
+	memset(block, 0, sizeof(block));
+	if (keylen > CSP_SHA1_BLOCKSIZE) {
+		csp_sha1_memory(key, keylen, block);
+	} else {
+		memcpy(block, key, keylen);
+	}
+
+	for (unsigned int i = 0; i < CSP_SHA1_BLOCKSIZE; i++) {
+		block[i] ^= 0x36;
+	}
+	csp_sha1_init(&mid->inner);
+	csp_sha1_process(&mid->inner, block, CSP_SHA1_BLOCKSIZE);
+
+	/* 0x36 ^ 0x5c: turn ipad into opad */
+	for (unsigned int i = 0; i < CSP_SHA1_BLOCKSIZE; i++) {
+		block[i] ^= 0x36 ^ 0x5c;
+	}
+	csp_sha1_init(&mid->outer);
+	csp_sha1_process(&mid->outer, block, CSP_SHA1_BLOCKSIZE);
+
+	memset(block, 0, sizeof(block));
+
+	return CSP_ERR_NONE;
+}
+
+static void csp_hmac_midstate_memory(const csp_hmac_midstate_t * mid, const void * data, uint32_t datalen, uint8_t * hmac) {
+
+	csp_sha1_state_t state = mid->inner;
+	csp_sha1_process(&state, data, datalen);
+	csp_sha1_done(&state, hmac);
+
+	state = mid->outer;
+	csp_sha1_process(&state, hmac, CSP_SHA1_DIGESTSIZE);
+	csp_sha1_done(&state, hmac);
+}
+
+int csp_hmac_memory(const void * key, uint32_t keylen, const void * data, uint32_t datalen, uint8_t * hmac) {
+
+	if (!key || !data || !hmac) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_hmac_midstate_t mid;
+	if (csp_hmac_midstate_init(&mid, key, keylen) != CSP_ERR_NONE) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_hmac_midstate_memory(&mid, data, datalen, hmac);
+
+	return CSP_ERR_NONE;
+}
+
+/**
+   libcsp.so uses an all-zero key until csp_hmac_set_key() is called - start from the midstate of that key.
+*/
+__attribute__((constructor))
+static void csp_hmac_setup(void) {
+
+	static const uint8_t key[CSP_HMAC_KEY_LENGTH];
+	csp_hmac_midstate_init(&csp_hmac_key_midstate, key, sizeof(key));
+}
+
+int csp_hmac_set_key(const void * key, uint32_t keylen) {
+
+	if (!key) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* Use SHA1 as KDF */
+	uint8_t hash[CSP_SHA1_DIGESTSIZE];
+	csp_sha1_memory(key, keylen, hash);
+
+	/* Only the first 16 bytes of the hash are used as key */
+	return csp_hmac_midstate_init(&csp_hmac_key_midstate, hash, CSP_HMAC_KEY_LENGTH);
+}
+
+int csp_hmac_append(csp_packet_t * packet, bool include_header) {
+
+	/* Calculate HMAC */
+	if ((packet->length + (unsigned int)CSP_HMAC_LENGTH) > csp_buffer_data_size()) {
+		return CSP_ERR_NOMEM;
+	}
+
+	uint8_t hmac[CSP_SHA1_DIGESTSIZE];
+	if (include_header) {
+		csp_hmac_midstate_memory(&csp_hmac_key_midstate, &packet->id, packet->length + sizeof(packet->id), hmac);
+	} else {
+		csp_hmac_midstate_memory(&csp_hmac_key_midstate, packet->data, packet->length, hmac);
+	}
+
+	/* Truncate hash and copy to packet */
+	memcpy(&packet->data[packet->length], hmac, CSP_HMAC_LENGTH);
+	packet->length += CSP_HMAC_LENGTH;
+
+	return CSP_ERR_NONE;
+}
+
+int csp_hmac_verify(csp_packet_t * packet, bool include_header) {
+
+	/* Calculate HMAC */
+	if (packet->length < (unsigned int)CSP_HMAC_LENGTH) {
+		return CSP_ERR_HMAC;
+	}
+
+	uint8_t hmac[CSP_SHA1_DIGESTSIZE];
+	if (include_header) {
+		csp_hmac_midstate_memory(&csp_hmac_key_midstate, &packet->id, packet->length + sizeof(packet->id) - CSP_HMAC_LENGTH, hmac);
+	} else {
+		csp_hmac_midstate_memory(&csp_hmac_key_midstate, packet->data, packet->length - CSP_HMAC_LENGTH, hmac);
+	}
+
+	/* Compare calculated HMAC with packet header */
+	if (memcmp(&packet->data[packet->length] - CSP_HMAC_LENGTH, hmac, CSP_HMAC_LENGTH) != 0) {
+		/* HMAC failed */
+		return CSP_ERR_HMAC;
+	}
+
+	/* Strip HMAC */
+	packet->length -= CSP_HMAC_LENGTH;
+
+	return CSP_ERR_NONE;
+}
@@ -0,0 +1,350 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*
+   SHA1 for csp_sha1_*().
+
+   libcsp calls the SHA1 functions through the PLT, so these definitions replace the plain C versions in libcsp.so - also
+   for csp_hmac_memory(). The block compression is selected at startup:
+
+   - x86 with SHA extensions (SHA-NI): sha1rnds4/sha1msg instructions.
+   - ARMv8 with SHA1 extension: sha1c/sha1p/sha1m/sha1su instructions (only if built with CSP_ARM_ACCEL).
+   - otherwise: plain C.
+
+   Consecutive full blocks are handed to the compression in one call, so the SIMD state stays in registers.
+*/
+
+#include <csp/crypto/csp_sha1.h>
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && defined(CSP_ARM_ACCEL)
+#pragma GCC push_options
+#pragma GCC target("+crypto")
+#include <arm_neon.h>
+#pragma GCC pop_options
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/** Load 32 bit big endian */
+#define CSP_SHA1_LOAD32H(p)	(((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+/** Rotate left */
+#define CSP_SHA1_ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+   Compress \a blocks consecutive 64 byte blocks into \a state.
+*/
+typedef void (*csp_sha1_compress_t)(uint32_t state[5], const uint8_t * data, uint32_t blocks);
+
+static void csp_sha1_compress_sw(uint32_t state[5], const uint8_t * data, uint32_t blocks);
+
+/** Selected implementation, set by csp_sha1_setup() */
+static csp_sha1_compress_t csp_sha1_compress = csp_sha1_compress_sw;
+
+static void csp_sha1_compress_sw(uint32_t state[5], const uint8_t * data, uint32_t blocks) {
+
+	for (; blocks; --blocks, data += CSP_SHA1_BLOCKSIZE) {
+
+		uint32_t w[16];
+		for (unsigned int i = 0; i < 16; i++) {
+			w[i] = CSP_SHA1_LOAD32H(data + (4 * i));
+		}
+
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		uint32_t e = state[4];
+
+		for (unsigned int i = 0; i < 80; i++) {
+			if (i >= 16) {
+				const uint32_t t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+				w[i & 15] = CSP_SHA1_ROL(t, 1);
+			}
+			uint32_t f;
+			if (i < 20) {
+				f = ((b & c) | (~b & d)) + 0x5a827999;
+			} else if (i < 40) {
+				f = (b ^ c ^ d) + 0x6ed9eba1;
+			} else if (i < 60) {
+				f = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+			} else {
+				f = (b ^ c ^ d) + 0xca62c1d6;
+			}
+			const uint32_t t = CSP_SHA1_ROL(a, 5) + f + e + w[i & 15];
+			e = d;
+			d = c;
+			c = CSP_SHA1_ROL(b, 30);
+			b = a;
+			a = t;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+#if defined(__x86_64__)
+
+/**
+   4 rounds, once the message schedule is running: consume \a m0, finish \a m1, and prepare \a m2 and \a m3.
+*/
+#define CSP_SHA1_NI_4ROUNDS(f, e, enext, m0, m1, m2, m3)	\
+	e = _mm_sha1nexte_epu32(e, m0);				\
+	enext = abcd;						\
+	m1 = _mm_sha1msg2_epu32(m1, m0);			\
+	abcd = _mm_sha1rnds4_epu32(abcd, e, f);			\
+	m3 = _mm_sha1msg1_epu32(m3, m0);			\
+	m2 = _mm_xor_si128(m2, m0)
+
+__attribute__((target("sse4.1,sha")))
+static void csp_sha1_compress_shani(uint32_t state[5], const uint8_t * data, uint32_t blocks) {
+
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int) state[4], 0, 0, 0);
+	__m128i e1;
+
+	for (; blocks; --blocks, data += CSP_SHA1_BLOCKSIZE) {
+
+		const __m128i abcd_save = abcd;
+		const __m128i e0_save = e0;
+
+		__m128i msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+		__m128i msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+		__m128i msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+		__m128i msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+		/* Rounds 0-11, message schedule starting up */
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* Rounds 12-67 */
+		CSP_SHA1_NI_4ROUNDS(0, e1, e0, msg3, msg0, msg1, msg2);
+		CSP_SHA1_NI_4ROUNDS(0, e0, e1, msg0, msg1, msg2, msg3);
+		CSP_SHA1_NI_4ROUNDS(1, e1, e0, msg1, msg2, msg3, msg0);
+		CSP_SHA1_NI_4ROUNDS(1, e0, e1, msg2, msg3, msg0, msg1);
+		CSP_SHA1_NI_4ROUNDS(1, e1, e0, msg3, msg0, msg1, msg2);
+		CSP_SHA1_NI_4ROUNDS(1, e0, e1, msg0, msg1, msg2, msg3);
+		CSP_SHA1_NI_4ROUNDS(1, e1, e0, msg1, msg2, msg3, msg0);
+		CSP_SHA1_NI_4ROUNDS(2, e0, e1, msg2, msg3, msg0, msg1);
+		CSP_SHA1_NI_4ROUNDS(2, e1, e0, msg3, msg0, msg1, msg2);
+		CSP_SHA1_NI_4ROUNDS(2, e0, e1, msg0, msg1, msg2, msg3);
+		CSP_SHA1_NI_4ROUNDS(2, e1, e0, msg1, msg2, msg3, msg0);
+		CSP_SHA1_NI_4ROUNDS(2, e0, e1, msg2, msg3, msg0, msg1);
+		CSP_SHA1_NI_4ROUNDS(3, e1, e0, msg3, msg0, msg1, msg2);
+		CSP_SHA1_NI_4ROUNDS(3, e0, e1, msg0, msg1, msg2, msg3);
+
+		/* Rounds 68-79, message schedule running out */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+#endif // __x86_64__
+
+#if defined(__aarch64__) && defined(__linux__) && defined(CSP_ARM_ACCEL)
+
+#pragma GCC push_options
+#pragma GCC target("+crypto")
+static void csp_sha1_compress_armv8(uint32_t state[5], const uint8_t * data, uint32_t blocks) {
+
+	uint32x4_t abcd = vld1q_u32(state);
+	uint32_t e = state[4];
+
+	for (; blocks; --blocks, data += CSP_SHA1_BLOCKSIZE) {
+
+		const uint32x4_t abcd_save = abcd;
+		const uint32_t e_save = e;
+
+		uint32x4_t w[4];
+		for (unsigned int i = 0; i < 4; i++) {
+			w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + (16 * i))));
+		}
+
+		/* 20 groups of 4 rounds, w[] holds the last 16 message words */
+		for (unsigned int g = 0; g < 20; g++) {
+			if (g >= 4) {
+				w[g & 3] = vsha1su1q_u32(vsha1su0q_u32(w[g & 3], w[(g + 1) & 3], w[(g + 2) & 3]), w[(g + 3) & 3]);
+			}
+			const uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			if (g < 5) {
+				abcd = vsha1cq_u32(abcd, e, vaddq_u32(w[g & 3], vdupq_n_u32(0x5a827999)));
+			} else if (g < 10) {
+				abcd = vsha1pq_u32(abcd, e, vaddq_u32(w[g & 3], vdupq_n_u32(0x6ed9eba1)));
+			} else if (g < 15) {
+				abcd = vsha1mq_u32(abcd, e, vaddq_u32(w[g & 3], vdupq_n_u32(0x8f1bbcdc)));
+			} else {
+				abcd = vsha1pq_u32(abcd, e, vaddq_u32(w[g & 3], vdupq_n_u32(0xca62c1d6)));
+			}
+			e = e_next;
+		}
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		e += e_save;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e;
+}
+#pragma GCC pop_options
+
+#endif // __aarch64__
+
+__attribute__((constructor))
+static void csp_sha1_setup(void) {
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+		csp_sha1_compress = csp_sha1_compress_shani;
+	}
+#elif defined(__aarch64__) && defined(__linux__) && defined(CSP_ARM_ACCEL)
+	if (getauxval(AT_HWCAP) & HWCAP_SHA1) {
+		csp_sha1_compress = csp_sha1_compress_armv8;
+	}
+#endif
+}
+
+void csp_sha1_init(csp_sha1_state_t * sha1) {
+
+	sha1->state[0] = 0x67452301UL;
+	sha1->state[1] = 0xefcdab89UL;
+	sha1->state[2] = 0x98badcfeUL;
+	sha1->state[3] = 0x10325476UL;
+	sha1->state[4] = 0xc3d2e1f0UL;
+	sha1->curlen = 0;
+	sha1->length = 0;
+}
+
+void csp_sha1_process(csp_sha1_state_t * sha1, const void * data, uint32_t length) {
+
+	const uint8_t * in = data;
+
+	/* Fill up a partial block first */
+	if (sha1->curlen) {
+		uint32_t n = CSP_SHA1_BLOCKSIZE - sha1->curlen;
+		if (n > length) {
+			n = length;
+		}
+		memcpy(sha1->buf + sha1->curlen, in, n);
+		sha1->curlen += n;
+		in += n;
+		length -= n;
+		if (sha1->curlen < CSP_SHA1_BLOCKSIZE) {
+			return;
+		}
+		csp_sha1_compress(sha1->state, sha1->buf, 1);
+		sha1->length += CSP_SHA1_BLOCKSIZE * 8;
+		sha1->curlen = 0;
+	}
+
+	/* Full blocks directly from input */
+	const uint32_t blocks = length / CSP_SHA1_BLOCKSIZE;
+	if (blocks) {
+		csp_sha1_compress(sha1->state, in, blocks);
+		sha1->length += (uint64_t) blocks * CSP_SHA1_BLOCKSIZE * 8;
+		in += blocks * CSP_SHA1_BLOCKSIZE;
+		length -= blocks * CSP_SHA1_BLOCKSIZE;
+	}
+
+	memcpy(sha1->buf, in, length);
+	sha1->curlen = length;
+}
+
+void csp_sha1_done(csp_sha1_state_t * sha1, uint8_t * out) {
+
+	/* Increase the length of the message */
+	sha1->length += sha1->curlen * 8;
+
+	/* Append the '1' bit */
+	sha1->buf[sha1->curlen++] = 0x80;
+
+	/* If the length is currently above 56 bytes, pad with zeros and compress, then fall back to padding zeros and length */
+	if (sha1->curlen > 56) {
+		memset(sha1->buf + sha1->curlen, 0, CSP_SHA1_BLOCKSIZE - sha1->curlen);
+		csp_sha1_compress(sha1->state, sha1->buf, 1);
+		sha1->curlen = 0;
+	}
+
+	/* Pad up to 56 bytes of zeroes and store length */
+	memset(sha1->buf + sha1->curlen, 0, 56 - sha1->curlen);
+	for (unsigned int i = 0; i < 8; i++) {
+		sha1->buf[56 + i] = (uint8_t)(sha1->length >> (56 - (8 * i)));
+	}
+	csp_sha1_compress(sha1->state, sha1->buf, 1);
+
+	/* Copy output */
+	for (unsigned int i = 0; i < 5; i++) {
+		out[(4 * i) + 0] = (uint8_t)(sha1->state[i] >> 24);
+		out[(4 * i) + 1] = (uint8_t)(sha1->state[i] >> 16);
+		out[(4 * i) + 2] = (uint8_t)(sha1->state[i] >> 8);
+		out[(4 * i) + 3] = (uint8_t)(sha1->state[i]);
+	}
+}
+
+void csp_sha1_memory(const void * data, uint32_t length, uint8_t * sha1) {
+
+	csp_sha1_state_t md;
+	csp_sha1_init(&md);
+	csp_sha1_process(&md, data, length);
+	csp_sha1_done(&md, sha1);
+}
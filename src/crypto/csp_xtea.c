@@ -0,0 +1,326 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*
+   XTEA in CTR mode for csp_xtea_*().
+
+   libcsp calls these functions through the PLT, so these definitions replace the versions in libcsp.so. The keystream is
+   compatible: block 0 and 1 use counter iv[1], block n > 1 uses iv[1] + n - 1, and iv[1] is advanced by the number of blocks.
+
+   The counter blocks are independent, so the keystream for a packet is calculated with one block per 32 bit SIMD lane (AVX2
+   8 lanes, SSE2/NEON 4 lanes), and two vectors in flight to hide the latency of the 32 dependent rounds. The per-round keys
+   (sum + k[...]) are the same for all blocks, and are precalculated by csp_xtea_set_key(). NEON is only used if built with
+   CSP_ARM_ACCEL.
+*/
+
+#include <csp/crypto/csp_xtea.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_endian.h>
+#include <csp/crypto/csp_sha1.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+#include <arm_neon.h>
+#endif
+
+#define XTEA_BLOCKSIZE 	8
+#define XTEA_ROUNDS 	32
+#define XTEA_KEY_LENGTH	16
+#define XTEA_DELTA	0x9E3779B9
+
+/** Number of counter blocks prepared per call to the block function */
+#define XTEA_CHUNK	64
+
+/** Per-round keys: sum + k[sum & 3] for v0, and sum + k[(sum >> 11) & 3] for v1 (after sum += delta) */
+static uint32_t csp_xtea_rk0[XTEA_ROUNDS];
+static uint32_t csp_xtea_rk1[XTEA_ROUNDS];
+
+/**
+   Encrypt \a n counter blocks (v0[i], v1[i]) in place.
+*/
+typedef void (*csp_xtea_blocks_t)(uint32_t * v0, uint32_t * v1, unsigned int n);
+
+static void csp_xtea_blocks_sw(uint32_t * v0, uint32_t * v1, unsigned int n) {
+
+	for (unsigned int b = 0; b < n; b++) {
+		uint32_t y = v0[b];
+		uint32_t z = v1[b];
+		for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+			y += (((z << 4) ^ (z >> 5)) + z) ^ csp_xtea_rk0[i];
+			z += (((y << 4) ^ (y >> 5)) + y) ^ csp_xtea_rk1[i];
+		}
+		v0[b] = y;
+		v1[b] = z;
+	}
+}
+
+#if defined(__x86_64__)
+
+/* SSE2 is part of x86-64, 4 blocks at a time */
+static void csp_xtea_blocks_sse2(uint32_t * v0, uint32_t * v1, unsigned int n) {
+
+	for (; n >= 4; n -= 4, v0 += 4, v1 += 4) {
+		__m128i y = _mm_loadu_si128((const __m128i *) v0);
+		__m128i z = _mm_loadu_si128((const __m128i *) v1);
+		for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+			__m128i t = _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(z, 4), _mm_srli_epi32(z, 5)), z);
+			y = _mm_add_epi32(y, _mm_xor_si128(t, _mm_set1_epi32((int) csp_xtea_rk0[i])));
+			t = _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(y, 4), _mm_srli_epi32(y, 5)), y);
+			z = _mm_add_epi32(z, _mm_xor_si128(t, _mm_set1_epi32((int) csp_xtea_rk1[i])));
+		}
+		_mm_storeu_si128((__m128i *) v0, y);
+		_mm_storeu_si128((__m128i *) v1, z);
+	}
+	csp_xtea_blocks_sw(v0, v1, n);
+}
+
+#define CSP_XTEA_AVX2_ROUND(y, z, rk0, rk1)											\
+	y = _mm256_add_epi32(y, _mm256_xor_si256(_mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(z, 4), _mm256_srli_epi32(z, 5)), z), rk0));	\
+	z = _mm256_add_epi32(z, _mm256_xor_si256(_mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(y, 4), _mm256_srli_epi32(y, 5)), y), rk1))
+
+__attribute__((target("avx2")))
+static void csp_xtea_blocks_avx2(uint32_t * v0, uint32_t * v1, unsigned int n) {
+
+	/* Two independent sets of 8 blocks, to hide the latency of the round dependency chain */
+	for (; n >= 16; n -= 16, v0 += 16, v1 += 16) {
+		__m256i ya = _mm256_loadu_si256((const __m256i *) v0);
+		__m256i za = _mm256_loadu_si256((const __m256i *) v1);
+		__m256i yb = _mm256_loadu_si256((const __m256i *)(v0 + 8));
+		__m256i zb = _mm256_loadu_si256((const __m256i *)(v1 + 8));
+		for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+			const __m256i rk0 = _mm256_set1_epi32((int) csp_xtea_rk0[i]);
+			const __m256i rk1 = _mm256_set1_epi32((int) csp_xtea_rk1[i]);
+			CSP_XTEA_AVX2_ROUND(ya, za, rk0, rk1);
+			CSP_XTEA_AVX2_ROUND(yb, zb, rk0, rk1);
+		}
+		_mm256_storeu_si256((__m256i *) v0, ya);
+		_mm256_storeu_si256((__m256i *) v1, za);
+		_mm256_storeu_si256((__m256i *)(v0 + 8), yb);
+		_mm256_storeu_si256((__m256i *)(v1 + 8), zb);
+	}
+	for (; n >= 8; n -= 8, v0 += 8, v1 += 8) {
+		__m256i y = _mm256_loadu_si256((const __m256i *) v0);
+		__m256i z = _mm256_loadu_si256((const __m256i *) v1);
+		for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+			CSP_XTEA_AVX2_ROUND(y, z, _mm256_set1_epi32((int) csp_xtea_rk0[i]), _mm256_set1_epi32((int) csp_xtea_rk1[i]));
+		}
+		_mm256_storeu_si256((__m256i *) v0, y);
+		_mm256_storeu_si256((__m256i *) v1, z);
+	}
+	csp_xtea_blocks_sse2(v0, v1, n);
+}
+
+#endif // __x86_64__
+
+#if defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+
+#define CSP_XTEA_NEON_ROUND(y, z, rk0, rk1)									\
+	y = vaddq_u32(y, veorq_u32(vaddq_u32(veorq_u32(vshlq_n_u32(z, 4), vshrq_n_u32(z, 5)), z), rk0));	\
+	z = vaddq_u32(z, veorq_u32(vaddq_u32(veorq_u32(vshlq_n_u32(y, 4), vshrq_n_u32(y, 5)), y), rk1))
+
+/* NEON is part of ARMv8-A */
+static void csp_xtea_blocks_neon(uint32_t * v0, uint32_t * v1, unsigned int n) {
+
+	for (; n >= 8; n -= 8, v0 += 8, v1 += 8) {
+		uint32x4_t ya = vld1q_u32(v0);
+		uint32x4_t za = vld1q_u32(v1);
+		uint32x4_t yb = vld1q_u32(v0 + 4);
+		uint32x4_t zb = vld1q_u32(v1 + 4);
+		for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+			const uint32x4_t rk0 = vdupq_n_u32(csp_xtea_rk0[i]);
+			const uint32x4_t rk1 = vdupq_n_u32(csp_xtea_rk1[i]);
+			CSP_XTEA_NEON_ROUND(ya, za, rk0, rk1);
+			CSP_XTEA_NEON_ROUND(yb, zb, rk0, rk1);
+		}
+		vst1q_u32(v0, ya);
+		vst1q_u32(v1, za);
+		vst1q_u32(v0 + 4, yb);
+		vst1q_u32(v1 + 4, zb);
+	}
+	for (; n >= 4; n -= 4, v0 += 4, v1 += 4) {
+		uint32x4_t y = vld1q_u32(v0);
+		uint32x4_t z = vld1q_u32(v1);
+		for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+			CSP_XTEA_NEON_ROUND(y, z, vdupq_n_u32(csp_xtea_rk0[i]), vdupq_n_u32(csp_xtea_rk1[i]));
+		}
+		vst1q_u32(v0, y);
+		vst1q_u32(v1, z);
+	}
+	csp_xtea_blocks_sw(v0, v1, n);
+}
+
+#endif // __aarch64__
+
+/**
+   Calculate the per-round keys for key \a k.
+*/
+static void csp_xtea_round_keys(const uint32_t k[XTEA_KEY_LENGTH / sizeof(uint32_t)]) {
+
+	uint32_t sum = 0;
+	for (unsigned int i = 0; i < XTEA_ROUNDS; i++) {
+		csp_xtea_rk0[i] = sum + k[sum & 3];
+		sum += XTEA_DELTA;
+		csp_xtea_rk1[i] = sum + k[(sum >> 11) & 3];
+	}
+}
+
+/** Selected implementation, set by csp_xtea_setup() */
+static csp_xtea_blocks_t csp_xtea_blocks = csp_xtea_blocks_sw;
+
+__attribute__((constructor))
+static void csp_xtea_setup(void) {
+
+#if defined(__x86_64__)
+	csp_xtea_blocks = csp_xtea_blocks_sse2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		csp_xtea_blocks = csp_xtea_blocks_avx2;
+	}
+#elif defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+	csp_xtea_blocks = csp_xtea_blocks_neon;
+#endif
+
+	/* libcsp.so uses an all-zero key until csp_xtea_set_key() is called */
+	static const uint32_t k[XTEA_KEY_LENGTH / sizeof(uint32_t)];
+	csp_xtea_round_keys(k);
+}
+
+int csp_xtea_set_key(const void * key, uint32_t keylen) {
+
+	/* Use SHA1 as KDF */
+	uint8_t hash[CSP_SHA1_DIGESTSIZE];
+	csp_sha1_memory(key, keylen, hash);
+
+	/* Copy key, only the first 16 bytes of the hash are used */
+	uint32_t k[XTEA_KEY_LENGTH / sizeof(uint32_t)];
+	memcpy(k, hash, XTEA_KEY_LENGTH);
+	csp_xtea_round_keys(k);
+
+	return CSP_ERR_NONE;
+}
+
+int csp_xtea_encrypt(void * plain, const uint32_t len, uint32_t iv[2]) {
+
+	uint8_t * data = plain;
+	const uint32_t blocks = (len + XTEA_BLOCKSIZE - 1) / XTEA_BLOCKSIZE;
+	const uint32_t iv0 = csp_htobe32(iv[0]);
+
+	for (uint32_t block = 0; block < blocks; ) {
+
+		/* Counter blocks, stored as big endian words like the original stream buffer. The first two blocks share a counter */
+		uint32_t v[2][XTEA_CHUNK];
+		const unsigned int n = (blocks - block) < XTEA_CHUNK ? (blocks - block) : XTEA_CHUNK;
+		for (unsigned int i = 0; i < n; i++) {
+			v[0][i] = iv0;
+			v[1][i] = csp_htobe32(iv[1] + (block + i) - ((block + i) > 0));
+		}
+
+		csp_xtea_blocks(v[0], v[1], n);
+
+		/* XOR data, full blocks 8 bytes at a time */
+		for (unsigned int i = 0; i < n; i++, block++) {
+			uint8_t stream[XTEA_BLOCKSIZE];
+			memcpy(stream, &v[0][i], sizeof(uint32_t));
+			memcpy(stream + sizeof(uint32_t), &v[1][i], sizeof(uint32_t));
+			uint8_t * p = &data[block * XTEA_BLOCKSIZE];
+			const uint32_t remain = len - (block * XTEA_BLOCKSIZE);
+			if (remain >= XTEA_BLOCKSIZE) {
+				uint64_t d, k;
+				memcpy(&d, p, sizeof(d));
+				memcpy(&k, stream, sizeof(k));
+				d ^= k;
+				memcpy(p, &d, sizeof(d));
+			} else {
+				for (unsigned int j = 0; j < remain; j++) {
+					p[j] ^= stream[j];
+				}
+			}
+		}
+	}
+
+	/* Increment counter */
+	iv[1] += blocks;
+
+	return CSP_ERR_NONE;
+}
+
+int csp_xtea_encrypt_packet(csp_packet_t * packet) {
+
+	/* Create nonce */
+	const uint32_t nonce = (uint32_t)rand();
+	const uint32_t nonce_n = csp_hton32(nonce);
+
+	/* Check that there is room for nonce */
+	if ((packet->length + sizeof(nonce_n)) > csp_buffer_data_size()) {
+		return CSP_ERR_NOMEM;
+	}
+
+	/* Create initialization vector */
+	uint32_t iv[2] = {nonce, 1};
+
+	/* Encrypt data */
+	if (csp_xtea_encrypt(packet->data, packet->length, iv) != 0) {
+		return CSP_ERR_XTEA;
+	}
+
+	/* Copy nonce */
+	memcpy(&packet->data[packet->length], &nonce_n, sizeof(nonce_n));
+	packet->length += sizeof(nonce_n);
+
+	return CSP_ERR_NONE;
+}
+
+int csp_xtea_decrypt(void * cipher, const uint32_t len, uint32_t iv[2]) {
+
+	/* Since we use counter mode, we can reuse the encryption function */
+	return csp_xtea_encrypt(cipher, len, iv);
+}
+
+int csp_xtea_decrypt_packet(csp_packet_t * packet) {
+
+	/* Read nonce */
+	if (packet->length < sizeof(uint32_t)) {
+		return CSP_ERR_XTEA;
+	}
+	uint32_t nonce;
+	memcpy(&nonce, &packet->data[packet->length - sizeof(nonce)], sizeof(nonce));
+	nonce = csp_ntoh32(nonce);
+
+	/* Create initialization vector */
+	uint32_t iv[2] = {nonce, 1};
+
+	/* Decrypt data (the nonce is stripped afterwards) */
+	if (csp_xtea_decrypt(packet->data, packet->length, iv) != 0) {
+		return CSP_ERR_XTEA;
+	}
+
+	/* Strip nonce */
+	packet->length -= sizeof(nonce);
+
+	return CSP_ERR_NONE;
+}
@@ -0,0 +1,72 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_CONN_H_
+#define _CSP_CONN_H_
+
+/**
+   @file
+
+   Internal connection layout and router functions of libcsp.so (v1.6).
+
+   csp_conn_t and csp_socket_t are opaque in the public API. Functions in this application that extend the connection
+   handling of libcsp.so (by interposing its exported functions) need access to the connection id and options, so the layout
+   is mirrored here - it must match the libcsp.so in include/csp. csp_init() checks this at startup (see csp_io_aead.c), and
+   disables AEAD if the options of a new socket are not found at the mirrored offset.
+*/
+
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Connection (and socket), as allocated by libcsp.so.
+*/
+struct csp_conn_s {
+	uint32_t type;			//!< Connection type (client/server)
+	uint32_t state;			//!< Connection state (open/closed)
+	csp_id_t idin;			//!< Identifier received
+	csp_id_t idout;			//!< Identifier transmitted
+	void * rx_queue[1];		//!< Queue for received packets (one per priority)
+	void * socket;			//!< Socket queue, for new connections
+	uint32_t timestamp;		//!< Time of last activity
+	uint32_t opts;			//!< Connection or socket options, see @ref CSP_SOCKET_OPTIONS
+	uint8_t rdp[96];		//!< RDP state
+};
+
+_Static_assert(sizeof(struct csp_conn_s) == 136, "struct csp_conn_s does not match libcsp.so");
+
+/**
+   Send packet directly on the interface, bypassing connections.
+   Exported by libcsp.so, used by csp_sendto().
+   @param[in] idout packet identifier.
+   @param[in] packet packet to send.
+   @param[in] ifroute route (interface and via address), see csp_rtable_find_route().
+   @param[in] timeout unused.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute, uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,73 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   CRC16 (poly 0x1021, init 0, not reflected) for EWC framing.
+
+   libcsp calls csp_crc16_memory() through the PLT, so this definition replaces the bytewise CRC16_TABLE version in
+   libcsp.so. Data is processed 8 bytes at a time with slicing-by-8 tables, the remainder one byte at a time.
+*/
+
+#include <csp/interfaces/csp_if_ewc.h>
+
+/** CRC16 polynomial (CCITT), not reflected */
+#define CSP_CRC16_POLY		0x1021
+
+/** Slicing-by-8 tables, crc16_tab[0] is the classic bytewise table (same as CRC16_TABLE) */
+static uint16_t crc16_tab[8][256];
+
+__attribute__((constructor))
+static void csp_crc16_init(void) {
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint16_t crc = (uint16_t)(i << 8);
+		for (unsigned int j = 0; j < 8; j++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ CSP_CRC16_POLY) : (uint16_t)(crc << 1);
+		}
+		crc16_tab[0][i] = crc;
+	}
+	for (unsigned int i = 0; i < 256; i++) {
+		for (unsigned int t = 1; t < 8; t++) {
+			const uint16_t prev = crc16_tab[t - 1][i];
+			crc16_tab[t][i] = (uint16_t)((prev << 8) ^ crc16_tab[0][prev >> 8]);
+		}
+	}
+}
+
+uint16_t csp_crc16_update(uint16_t crc, const uint8_t * data, size_t len) {
+
+	while (len >= 8) {
+		crc = crc16_tab[7][data[0] ^ (crc >> 8)] ^ crc16_tab[6][data[1] ^ (crc & 0xFF)] ^
+		      crc16_tab[5][data[2]] ^ crc16_tab[4][data[3]] ^ crc16_tab[3][data[4]] ^
+		      crc16_tab[2][data[5]] ^ crc16_tab[1][data[6]] ^ crc16_tab[0][data[7]];
+		data += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = (uint16_t)(crc16_tab[0][(crc >> 8) ^ *data++] ^ (crc << 8));
+	}
+
+	return crc;
+}
+
+uint16_t csp_crc16_memory(const uint8_t *pData, uint16_t len) {
+	return csp_crc16_update(0, pData, len);
+}
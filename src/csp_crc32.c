@@ -0,0 +1,250 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   CRC32-C (Castagnoli) for csp_crc32_memory().
+
+   libcsp calls csp_crc32_memory() through the PLT, so this definition replaces the bytewise table version in libcsp.so - also
+   for csp_crc32_append() and csp_crc32_verify(). The implementation is selected at startup:
+
+   - x86 with SSE4.2 + PCLMUL: 3 interleaved crc32 instruction streams, combined by carry-less multiplication.
+   - x86 with SSE4.2: crc32 instruction, 8 bytes at a time.
+   - ARMv8 with CRC extension: crc32c instruction, 8 bytes at a time (only if built with CSP_ARM_ACCEL).
+   - otherwise: slicing-by-8 tables.
+*/
+
+#include <csp/csp_crc32.h>
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && defined(CSP_ARM_ACCEL)
+#pragma GCC push_options
+#pragma GCC target("+crc")
+#include <arm_acle.h>
+#pragma GCC pop_options
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/** CRC32-C polynomial, bit reflected */
+#define CSP_CRC32_POLY		0x82F63B78
+
+/** Block size of each of the 3 interleaved streams */
+#define CSP_CRC32_BLOCK		128
+
+/**
+   Update CRC state (no pre/post inversion).
+*/
+typedef uint32_t (*csp_crc32_update_t)(uint32_t crc, const uint8_t * data, uint32_t length);
+
+/** Slicing-by-8 tables, crc_tab[0] is the classic bytewise table */
+static uint32_t crc_tab[8][256];
+
+static uint32_t csp_crc32_update_sw(uint32_t crc, const uint8_t * data, uint32_t length);
+
+/** Selected implementation, set by csp_crc32_init() */
+static csp_crc32_update_t csp_crc32_update = csp_crc32_update_sw;
+
+static uint32_t csp_crc32_update_sw(uint32_t crc, const uint8_t * data, uint32_t length) {
+
+#if (CSP_LITTLE_ENDIAN)
+	while (length >= 8) {
+		uint32_t lo, hi;
+		memcpy(&lo, data, sizeof(lo));
+		memcpy(&hi, data + 4, sizeof(hi));
+		lo ^= crc;
+		crc = crc_tab[7][lo & 0xFF] ^ crc_tab[6][(lo >> 8) & 0xFF] ^ crc_tab[5][(lo >> 16) & 0xFF] ^ crc_tab[4][lo >> 24] ^
+		      crc_tab[3][hi & 0xFF] ^ crc_tab[2][(hi >> 8) & 0xFF] ^ crc_tab[1][(hi >> 16) & 0xFF] ^ crc_tab[0][hi >> 24];
+		data += 8;
+		length -= 8;
+	}
+#endif
+
+	while (length--) {
+		crc = crc_tab[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+
+/** Constants for shifting a CRC state past 1 and 2 blocks: x^(8 * n - 33) mod P */
+static uint32_t csp_crc32_k1;
+static uint32_t csp_crc32_k2;
+
+__attribute__((target("sse4.2")))
+static uint32_t csp_crc32_update_sse42(uint32_t crc, const uint8_t * data, uint32_t length) {
+
+	uint64_t crc64 = crc;
+
+	for (; length && ((uintptr_t) data & 7); --length) {
+		crc64 = _mm_crc32_u8((uint32_t) crc64, *data++);
+	}
+	for (; length >= 8; length -= 8, data += 8) {
+		uint64_t v;
+		memcpy(&v, data, sizeof(v));
+		crc64 = _mm_crc32_u64(crc64, v);
+	}
+	for (; length; --length) {
+		crc64 = _mm_crc32_u8((uint32_t) crc64, *data++);
+	}
+
+	return (uint32_t) crc64;
+}
+
+/**
+   Shift CRC state by multiplying with constant \a k, and reduce the 64 bit product with the crc32 instruction.
+*/
+__attribute__((target("sse4.2,pclmul")))
+static inline uint64_t csp_crc32_shift_pclmul(uint32_t crc, uint32_t k) {
+	__m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int) crc), _mm_cvtsi32_si128((int) k), 0x00);
+	return _mm_crc32_u64(0, (uint64_t) _mm_cvtsi128_si64(product));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t csp_crc32_update_pclmul(uint32_t crc, const uint8_t * data, uint32_t length) {
+
+	/* The crc32 instruction has a latency of 3 cycles but a throughput of 1, so run 3 independent streams */
+	while (length >= (3 * CSP_CRC32_BLOCK)) {
+		uint64_t crc0 = crc;
+		uint64_t crc1 = 0;
+		uint64_t crc2 = 0;
+		for (unsigned int i = 0; i < CSP_CRC32_BLOCK; i += 8) {
+			uint64_t v0, v1, v2;
+			memcpy(&v0, data + i, sizeof(v0));
+			memcpy(&v1, data + CSP_CRC32_BLOCK + i, sizeof(v1));
+			memcpy(&v2, data + (2 * CSP_CRC32_BLOCK) + i, sizeof(v2));
+			crc0 = _mm_crc32_u64(crc0, v0);
+			crc1 = _mm_crc32_u64(crc1, v1);
+			crc2 = _mm_crc32_u64(crc2, v2);
+		}
+		crc = (uint32_t)(csp_crc32_shift_pclmul((uint32_t) crc0, csp_crc32_k2) ^
+		                 csp_crc32_shift_pclmul((uint32_t) crc1, csp_crc32_k1) ^ crc2);
+		data += 3 * CSP_CRC32_BLOCK;
+		length -= 3 * CSP_CRC32_BLOCK;
+	}
+
+	return csp_crc32_update_sse42(crc, data, length);
+}
+
+/**
+   Multiply \a a and \a b modulo the CRC polynomial (bit reflected).
+*/
+static uint32_t csp_crc32_multmodp(uint32_t a, uint32_t b) {
+
+	uint32_t m = (uint32_t) 1 << 31;
+	uint32_t p = 0;
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) {
+				break;
+			}
+		}
+		m >>= 1;
+		b = (b & 1) ? ((b >> 1) ^ CSP_CRC32_POLY) : (b >> 1);
+	}
+	return p;
+}
+
+/**
+   Return x^n modulo the CRC polynomial (bit reflected).
+*/
+static uint32_t csp_crc32_xpow(uint32_t n) {
+
+	uint32_t result = (uint32_t) 1 << 31; // x^0
+	uint32_t square = (uint32_t) 1 << 30; // x^1
+	for (; n; n >>= 1) {
+		if (n & 1) {
+			result = csp_crc32_multmodp(square, result);
+		}
+		square = csp_crc32_multmodp(square, square);
+	}
+	return result;
+}
+
+#endif // __x86_64__
+
+#if defined(__aarch64__) && defined(__linux__) && defined(CSP_ARM_ACCEL)
+
+#pragma GCC push_options
+#pragma GCC target("+crc")
+static uint32_t csp_crc32_update_armv8(uint32_t crc, const uint8_t * data, uint32_t length) {
+
+	for (; length && ((uintptr_t) data & 7); --length) {
+		crc = __crc32cb(crc, *data++);
+	}
+	for (; length >= 8; length -= 8, data += 8) {
+		uint64_t v;
+		memcpy(&v, data, sizeof(v));
+		crc = __crc32cd(crc, v);
+	}
+	for (; length; --length) {
+		crc = __crc32cb(crc, *data++);
+	}
+
+	return crc;
+}
+#pragma GCC pop_options
+
+#endif // __aarch64__
+
+__attribute__((constructor))
+static void csp_crc32_init(void) {
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (unsigned int j = 0; j < 8; j++) {
+			crc = (crc & 1) ? ((crc >> 1) ^ CSP_CRC32_POLY) : (crc >> 1);
+		}
+		crc_tab[0][i] = crc;
+	}
+	for (unsigned int i = 0; i < 256; i++) {
+		for (unsigned int t = 1; t < 8; t++) {
+			crc_tab[t][i] = crc_tab[0][crc_tab[t - 1][i] & 0xFF] ^ (crc_tab[t - 1][i] >> 8);
+		}
+	}
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		csp_crc32_update = csp_crc32_update_sse42;
+		if (__builtin_cpu_supports("pclmul")) {
+			csp_crc32_k1 = csp_crc32_xpow((8 * CSP_CRC32_BLOCK) - 33);
+			csp_crc32_k2 = csp_crc32_xpow((8 * 2 * CSP_CRC32_BLOCK) - 33);
+			csp_crc32_update = csp_crc32_update_pclmul;
+		}
+	}
+#elif defined(__aarch64__) && defined(__linux__) && defined(CSP_ARM_ACCEL)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		csp_crc32_update = csp_crc32_update_armv8;
+	}
+#endif
+}
+
+uint32_t csp_crc32_memory(const uint8_t * addr, uint32_t length) {
+	return csp_crc32_update(0xFFFFFFFF, addr, length) ^ 0xFFFFFFFF;
+}
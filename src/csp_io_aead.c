@@ -0,0 +1,289 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   AEAD (#CSP_FAEAD) support for connections and connection-less sockets.
+
+   libcsp.so has no knowledge of the AEAD flag and options, so the send/receive functions are interposed here, and the
+   libcsp.so versions are called through dlsym(RTLD_NEXT). Functions in libcsp.so calling these through the PLT (e.g.
+   csp_transaction(), csp_send_prio(), csp_sendto_reply() and SFP) are covered as well.
+
+   - csp_init(): checks that the connection layout mirrored in csp_conn.h matches the loaded libcsp.so. If it doesn't, AEAD is
+     disabled: the connections are left to libcsp.so, AEAD is refused (#CSP_SO_AEADREQ / #CSP_O_AEAD) and packets with
+     #CSP_FAEAD are dropped.
+   - csp_socket()/csp_connect(): the AEAD options are kept out of libcsp.so's option check, and stored in the socket/connection.
+   - csp_send()/csp_sendto(): packets are encrypted, if the connection (or the options) use AEAD.
+   - csp_read()/csp_recvfrom(): packets with #CSP_FAEAD are decrypted. Packets failing authentication, or not matching the
+     #CSP_SO_AEADREQ / #CSP_SO_AEADPROHIB options, are dropped.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <stdlib.h>
+
+#include <csp/csp.h>
+#include <csp/csp_debug.h>
+#include <csp/arch/csp_time.h>
+#include <csp/crypto/csp_aead.h>
+
+#include "csp_conn.h"
+
+/** All AEAD socket/connection options */
+#define CSP_SO_AEAD_MASK	(CSP_SO_AEADREQ | CSP_SO_AEADPROHIB)
+
+/** Socket options used to check the connection layout: accepted by libcsp.so in include/csp, and non-zero */
+#define CSP_IO_AEAD_PROBE_OPTS	(CSP_SO_RDPREQ | CSP_SO_HMACREQ | CSP_SO_CRC32REQ)
+
+typedef int (*csp_init_fnc_t)(const csp_conf_t * conf);
+typedef csp_socket_t * (*csp_socket_fnc_t)(uint32_t opts);
+typedef csp_conn_t * (*csp_accept_fnc_t)(csp_socket_t * socket, uint32_t timeout);
+typedef csp_conn_t * (*csp_connect_fnc_t)(uint8_t prio, uint8_t dst, uint8_t dst_port, uint32_t timeout, uint32_t opts);
+typedef int (*csp_send_fnc_t)(csp_conn_t * conn, csp_packet_t * packet, uint32_t timeout);
+typedef int (*csp_sendto_fnc_t)(uint8_t prio, uint8_t dst, uint8_t dst_port, uint8_t src_port, uint32_t opts, csp_packet_t * packet, uint32_t timeout);
+typedef csp_packet_t * (*csp_read_fnc_t)(csp_conn_t * conn, uint32_t timeout);
+
+/** libcsp.so functions, set by csp_io_aead_init() */
+static csp_init_fnc_t csp_init_next;
+static csp_socket_fnc_t csp_socket_next;
+static csp_accept_fnc_t csp_accept_next;
+static csp_connect_fnc_t csp_connect_next;
+static csp_send_fnc_t csp_send_next;
+static csp_sendto_fnc_t csp_sendto_next;
+static csp_read_fnc_t csp_read_next;
+static csp_read_fnc_t csp_recvfrom_next;
+
+/** AEAD is enabled, if csp_init() found the connection layout in csp_conn.h */
+static bool csp_io_aead_enabled;
+
+__attribute__((constructor))
+static void csp_io_aead_init(void) {
+
+	csp_init_next = (csp_init_fnc_t) dlsym(RTLD_NEXT, "csp_init");
+	csp_socket_next = (csp_socket_fnc_t) dlsym(RTLD_NEXT, "csp_socket");
+	csp_accept_next = (csp_accept_fnc_t) dlsym(RTLD_NEXT, "csp_accept");
+	csp_connect_next = (csp_connect_fnc_t) dlsym(RTLD_NEXT, "csp_connect");
+	csp_send_next = (csp_send_fnc_t) dlsym(RTLD_NEXT, "csp_send");
+	csp_sendto_next = (csp_sendto_fnc_t) dlsym(RTLD_NEXT, "csp_sendto");
+	csp_read_next = (csp_read_fnc_t) dlsym(RTLD_NEXT, "csp_read");
+	csp_recvfrom_next = (csp_read_fnc_t) dlsym(RTLD_NEXT, "csp_recvfrom");
+
+	if (!csp_init_next || !csp_socket_next || !csp_accept_next || !csp_connect_next || !csp_send_next || !csp_sendto_next ||
+	    !csp_read_next || !csp_recvfrom_next) {
+		/* Can't continue without libcsp.so */
+		abort();
+	}
+}
+
+/**
+   Check and decrypt received packet.
+   @return true if the packet should be delivered, false if it has been dropped (and freed).
+*/
+static bool csp_io_aead_rx(csp_packet_t * packet, uint32_t opts) {
+
+	if (packet->id.flags & CSP_FAEAD) {
+		if (opts & CSP_SO_AEADPROHIB) {
+			csp_log_warn("Received packet with AEAD, but AEAD is prohibited, id: 0x%08"PRIx32, packet->id.ext);
+		} else if (csp_aead_decrypt_packet(packet, true) != CSP_ERR_NONE) {
+			csp_log_warn("AEAD authentication failed, id: 0x%08"PRIx32, packet->id.ext);
+		} else {
+			return true;
+		}
+	} else if (opts & CSP_SO_AEADREQ) {
+		csp_log_warn("Received packet without AEAD, but AEAD is required, id: 0x%08"PRIx32, packet->id.ext);
+	} else {
+		return true;
+	}
+
+	csp_buffer_free(packet);
+	return false;
+}
+
+/**
+   Receive with \a read, until a packet passes csp_io_aead_rx() or \a timeout expires.
+*/
+static csp_packet_t * csp_io_aead_read(csp_read_fnc_t read, struct csp_conn_s * conn, uint32_t timeout) {
+
+	const uint32_t opts = csp_io_aead_enabled ? conn->opts : CSP_SO_AEADPROHIB;
+	const uint32_t start = csp_get_ms();
+	uint32_t remaining = timeout;
+
+	for (;;) {
+		csp_packet_t * packet = read(conn, remaining);
+		if (packet == NULL) {
+			return NULL;
+		}
+		if (csp_io_aead_rx(packet, opts)) {
+			return packet;
+		}
+		if (timeout != CSP_MAX_TIMEOUT) {
+			const uint32_t elapsed = csp_get_ms() - start;
+			if (elapsed >= timeout) {
+				return NULL;
+			}
+			remaining = timeout - elapsed;
+		}
+	}
+}
+
+/**
+   Check that struct csp_conn_s matches libcsp.so, by reading back the options of a new socket.
+   A libcsp.so built with other CSP_USE_* options may reject the options (e.g. without RDP), or store them at another offset.
+*/
+static bool csp_io_aead_conn_layout_ok(void) {
+
+	struct csp_conn_s * probe = csp_socket_next(CSP_IO_AEAD_PROBE_OPTS);
+	if (probe == NULL) {
+		return false;
+	}
+	const bool ok = (probe->opts == CSP_IO_AEAD_PROBE_OPTS) && (probe->socket == NULL);
+	csp_close(probe);
+
+	return ok;
+}
+
+int csp_init(const csp_conf_t * conf) {
+
+	int res = csp_init_next(conf);
+	if (res == CSP_ERR_NONE) {
+		/* Otherwise AEAD options and flags would be written at the wrong offsets, corrupting connections */
+		csp_io_aead_enabled = csp_io_aead_conn_layout_ok();
+		if (!csp_io_aead_enabled) {
+			csp_log_error("libcsp.so does not match the connection layout in csp_conn.h - built with other CSP_USE_* options? AEAD disabled");
+		}
+	}
+	return res;
+}
+
+csp_socket_t * csp_socket(uint32_t opts) {
+
+	if (!csp_io_aead_enabled) {
+		/* Without AEAD, packets with AEAD are always dropped - as if prohibited */
+		return (opts & CSP_SO_AEADREQ) ? NULL : csp_socket_next(opts & ~CSP_SO_AEAD_MASK);
+	}
+
+	csp_socket_t * sock = csp_socket_next(opts & ~CSP_SO_AEAD_MASK);
+	if (sock) {
+		sock->opts |= (opts & CSP_SO_AEAD_MASK);
+	}
+	return sock;
+}
+
+csp_conn_t * csp_accept(csp_socket_t * sock, uint32_t timeout) {
+
+	csp_conn_t * conn = csp_accept_next(sock, timeout);
+	if (conn && sock && csp_io_aead_enabled) {
+		conn->opts |= (sock->opts & CSP_SO_AEAD_MASK);
+		if (conn->opts & CSP_SO_AEADREQ) {
+			conn->idout.flags |= CSP_FAEAD;
+		}
+	}
+	return conn;
+}
+
+csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t timeout, uint32_t opts) {
+
+	if (!csp_io_aead_enabled) {
+		return (opts & CSP_O_AEAD) ? NULL : csp_connect_next(prio, dest, dport, timeout, opts & ~CSP_SO_AEAD_MASK);
+	}
+
+	csp_conn_t * conn = csp_connect_next(prio, dest, dport, timeout, opts & ~CSP_SO_AEAD_MASK);
+	if (conn) {
+		conn->opts |= (opts & CSP_SO_AEAD_MASK);
+		if (opts & CSP_O_AEAD) {
+			conn->idout.flags |= CSP_FAEAD;
+		}
+	}
+	return conn;
+}
+
+int csp_send(csp_conn_t * conn, csp_packet_t * packet, uint32_t timeout) {
+
+	if (csp_io_aead_enabled && conn && packet && (conn->idout.flags & CSP_FAEAD)) {
+		/* The identifier is authenticated, so set it before encryption (as libcsp.so will do) */
+		packet->id.ext = conn->idout.ext;
+		if (csp_aead_encrypt_packet(packet, true) != CSP_ERR_NONE) {
+			csp_log_warn("AEAD encryption failed");
+			return 0;
+		}
+	}
+	return csp_send_next(conn, packet, timeout);
+}
+
+int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint32_t opts, csp_packet_t * packet, uint32_t timeout) {
+
+	if ((opts & CSP_O_AEAD) == 0) {
+		return csp_sendto_next(prio, dest, dport, src_port, opts & ~CSP_SO_AEAD_MASK, packet, timeout);
+	}
+
+	if (!csp_io_aead_enabled) {
+		return CSP_ERR_NOTSUP;
+	}
+
+	if (opts & CSP_O_RDP) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* Same identifier as libcsp.so, plus AEAD */
+	packet->id.pri = prio;
+	packet->id.dst = dest;
+	packet->id.src = csp_get_address();
+	packet->id.dport = dport;
+	packet->id.sport = src_port;
+	packet->id.flags = CSP_FAEAD;
+	if (opts & CSP_O_HMAC) {
+		packet->id.flags |= CSP_FHMAC;
+	}
+	if (opts & CSP_O_XTEA) {
+		packet->id.flags |= CSP_FXTEA;
+	}
+	if (opts & CSP_O_CRC32) {
+		packet->id.flags |= CSP_FCRC32;
+	}
+
+	int res = csp_aead_encrypt_packet(packet, true);
+	if (res != CSP_ERR_NONE) {
+		return res;
+	}
+
+	if (csp_send_direct(packet->id, packet, csp_rtable_find_route(dest), timeout) != CSP_ERR_NONE) {
+		return CSP_ERR_NOTSUP;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+csp_packet_t * csp_read(csp_conn_t * conn, uint32_t timeout) {
+
+	if (conn == NULL) {
+		return NULL;
+	}
+	return csp_io_aead_read(csp_read_next, conn, timeout);
+}
+
+csp_packet_t * csp_recvfrom(csp_socket_t * sock, uint32_t timeout) {
+
+	if (sock == NULL) {
+		return NULL;
+	}
+	return csp_io_aead_read(csp_recvfrom_next, sock, timeout);
+}
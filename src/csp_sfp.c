@@ -0,0 +1,900 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <csp/csp.h>
+#include <csp/csp_crc32.h>
+#include <csp/csp_endian.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_thread.h>
+#include <csp/arch/csp_time.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+   SFP header, appended to the data of each packet (network byte order).
+   Same layout as used by csp_sfp_send_own_memcpy() and csp_sfp_recv_fp().
+*/
+typedef struct __attribute__((__packed__)) {
+	uint32_t offset;
+	uint32_t totalsize;
+} sfp_header_t;
+
+static inline sfp_header_t * csp_sfp_header_add(csp_packet_t * packet) {
+	sfp_header_t * header = (sfp_header_t *) &packet->data[packet->length];
+	packet->length += sizeof(sfp_header_t);
+	memset(header, 0, sizeof(sfp_header_t));
+	return header;
+}
+
+static inline sfp_header_t * csp_sfp_header_remove(csp_packet_t * packet) {
+	sfp_header_t * header = (sfp_header_t *) &packet->data[packet->length - sizeof(sfp_header_t)];
+	packet->length -= sizeof(sfp_header_t);
+	return header;
+}
+
+/**
+   Send a resume checkpoint (request or reply): the CRC32 of the transfer followed by a SFP header.
+*/
+static int csp_sfp_send_checkpoint(csp_conn_t * conn, uint32_t offset, uint32_t totalsize, uint32_t crc) {
+
+	csp_packet_t * packet = csp_buffer_get(sizeof(crc) + sizeof(sfp_header_t));
+	if (packet == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	crc = csp_hton32(crc);
+	memcpy(packet->data, &crc, sizeof(crc));
+	packet->length = sizeof(crc);
+
+	sfp_header_t * sfp_header = csp_sfp_header_add(packet);
+	sfp_header->offset = csp_hton32(offset);
+	sfp_header->totalsize = csp_hton32(totalsize);
+
+	if (!csp_send(conn, packet, 0)) {
+		csp_buffer_free(packet);
+		return CSP_ERR_TX;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+/**
+   Read the CRC32 from a resume checkpoint, once the SFP header has been removed.
+*/
+static inline uint32_t csp_sfp_checkpoint_crc(const csp_packet_t * packet) {
+	uint32_t crc;
+	memcpy(&crc, packet->data, sizeof(crc));
+	return csp_ntoh32(crc);
+}
+
+/**
+   Send a single chunk of \a size bytes at \a offset, with absolute offset in the SFP header.
+*/
+static int csp_sfp_send_chunk(csp_conn_t * conn, const uint8_t * data, uint32_t totalsize, uint32_t offset, uint32_t size) {
+
+	csp_packet_t * packet = csp_buffer_get(size + sizeof(sfp_header_t));
+	if (packet == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	memcpy(packet->data, &data[offset], size);
+	packet->length = size;
+
+	sfp_header_t * sfp_header = csp_sfp_header_add(packet);
+	sfp_header->offset = csp_hton32(offset);
+	sfp_header->totalsize = csp_hton32(totalsize);
+
+	if (!csp_send(conn, packet, 0)) {
+		csp_buffer_free(packet);
+		return CSP_ERR_TX;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+/**
+   Send data in range [begin, end[ as chunks of \a mtu bytes, with absolute offsets in the SFP header.
+*/
+static int csp_sfp_send_range(csp_conn_t * conn, const uint8_t * data, uint32_t totalsize, uint32_t begin, uint32_t end, unsigned int mtu) {
+
+	uint32_t count = begin;
+	while (count < end) {
+
+		/* Calculate sending size */
+		uint32_t size = end - count;
+		if (size > mtu) {
+			size = mtu;
+		}
+
+		int error = csp_sfp_send_chunk(conn, data, totalsize, count, size);
+		if (error != CSP_ERR_NONE) {
+			return error;
+		}
+
+		count += size;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+/** Read-ahead window for csp_sfp_send_file(), must be a multiple of the page size. */
+#define CSP_SFP_FILE_READAHEAD	(1024 * 1024)
+
+/** End of the file mapping being sent by csp_sfp_send_file() on this thread, bounds the read-ahead requests. */
+static __thread uintptr_t csp_sfp_file_map_end;
+
+/**
+   Memory copy function used on file mappings.
+
+   When a chunk crosses into a new read-ahead window, the window after it is requested, so the page cache stays one window
+   ahead of the transfer. The request is clamped to the end of the mapping.
+*/
+static csp_memptr_t csp_sfp_file_memcpy(csp_memptr_t dst, csp_const_memptr_t src, size_t size) {
+
+	const uintptr_t start = (uintptr_t) src;
+	const uintptr_t end = start + size;
+
+	if ((size > 0) && ((start / CSP_SFP_FILE_READAHEAD) != ((end - 1) / CSP_SFP_FILE_READAHEAD))) {
+		const uintptr_t next = (((end - 1) / CSP_SFP_FILE_READAHEAD) + 1) * CSP_SFP_FILE_READAHEAD;
+		if (next < csp_sfp_file_map_end) {
+			const uintptr_t len = csp_sfp_file_map_end - next;
+			madvise((void *) next, (len < CSP_SFP_FILE_READAHEAD) ? len : CSP_SFP_FILE_READAHEAD, MADV_WILLNEED);
+		}
+	}
+
+	return memcpy(dst, src, size);
+}
+
+int csp_sfp_send_file(csp_conn_t * conn, int fd, off_t offset, size_t len, unsigned int mtu) {
+
+	if ((len == 0) || (len > UINT32_MAX) || (offset < 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* Mapping past end of file succeeds, but touching it raises SIGBUS */
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		csp_log_error("%s: fstat(fd %d) failed, error: %s", __FUNCTION__, fd, strerror(errno));
+		return CSP_ERR_INVAL;
+	}
+	if ((uint64_t) offset + len > (uint64_t) st.st_size) {
+		csp_log_error("%s: offset %lld + len %zu exceeds file size %lld",
+		              __FUNCTION__, (long long) offset, len, (long long) st.st_size);
+		return CSP_ERR_INVAL;
+	}
+
+	/* mmap() requires a page aligned offset */
+	const off_t page_mask = (off_t) sysconf(_SC_PAGESIZE) - 1;
+	const off_t map_offset = offset & ~page_mask;
+	const size_t map_delta = (size_t)(offset - map_offset);
+	const size_t map_len = map_delta + len;
+
+	uint8_t * map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, map_offset);
+	if (map == MAP_FAILED) {
+		csp_log_error("%s: mmap(fd %d, offset %lld, len %zu) failed, error: %s",
+		              __FUNCTION__, fd, (long long) offset, len, strerror(errno));
+		return CSP_ERR_NOMEM;
+	}
+
+	/* Sequential access lets the kernel read ahead aggressively and drop pages behind us. Prime the first two windows. */
+	madvise(map, map_len, MADV_SEQUENTIAL);
+	madvise(map, (map_len < (2 * CSP_SFP_FILE_READAHEAD)) ? map_len : (2 * CSP_SFP_FILE_READAHEAD), MADV_WILLNEED);
+
+	csp_sfp_file_map_end = (uintptr_t) map + map_len;
+	int error = csp_sfp_send_own_memcpy(conn, &map[map_delta], (unsigned int) len, mtu, 0, csp_sfp_file_memcpy);
+	csp_sfp_file_map_end = 0;
+
+	munmap(map, map_len);
+
+	return error;
+}
+
+int csp_sfp_send_resume(csp_conn_t * conn, const void * data, unsigned int datasize, unsigned int mtu, uint32_t timeout) {
+
+	if ((mtu == 0) || (datasize == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* The CRC32 identifies the transfer, so the receiver doesn't resume a different transfer of the same size */
+	const uint32_t crc = csp_crc32_memory(data, datasize);
+
+	/* Ask for the receiver's checkpoint */
+	int error = csp_sfp_send_checkpoint(conn, 0, datasize, crc);
+	if (error != CSP_ERR_NONE) {
+		return error;
+	}
+
+	csp_packet_t * packet = csp_read(conn, timeout);
+	if (packet == NULL) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	if (packet->length != (sizeof(crc) + sizeof(sfp_header_t))) {
+		csp_log_error("%s: %u:%u, invalid checkpoint, length: %u",
+		              __FUNCTION__, packet->id.src, packet->id.sport, packet->length);
+		csp_buffer_free(packet);
+		return CSP_ERR_SFP;
+	}
+
+	sfp_header_t * sfp_header = csp_sfp_header_remove(packet);
+	const uint32_t offset = csp_ntoh32(sfp_header->offset);
+	const uint32_t totalsize = csp_ntoh32(sfp_header->totalsize);
+	const uint32_t checkpoint_crc = csp_sfp_checkpoint_crc(packet);
+	csp_buffer_free(packet);
+
+	if ((totalsize != datasize) || (checkpoint_crc != crc) || (offset > datasize)) {
+		csp_log_error("%s: checkpoint %"PRIu32" / %"PRIu32" (crc 0x%08"PRIx32") doesn't match transfer size %u (crc 0x%08"PRIx32")",
+		              __FUNCTION__, offset, totalsize, checkpoint_crc, datasize, crc);
+		return CSP_ERR_SFP;
+	}
+
+	csp_log_protocol("%s: resuming at offset %"PRIu32" of %u", __FUNCTION__, offset, datasize);
+
+	return csp_sfp_send_range(conn, data, datasize, offset, datasize, mtu);
+}
+
+int csp_sfp_recv_resume(csp_conn_t * conn, csp_sfp_resume_t * state, uint32_t timeout, csp_packet_t * first_packet) {
+
+	csp_packet_t * packet;
+
+	/* First packet is the sender's request for our checkpoint */
+	if ((packet = first_packet) == NULL) {
+		if ((packet = csp_read(conn, timeout)) == NULL) {
+			return CSP_ERR_TIMEDOUT;
+		}
+	}
+
+	if (packet->length != (sizeof(uint32_t) + sizeof(sfp_header_t))) {
+		csp_log_error("%s: %u:%u, invalid checkpoint request, length: %u",
+		              __FUNCTION__, packet->id.src, packet->id.sport, packet->length);
+		csp_buffer_free(packet);
+		return CSP_ERR_SFP;
+	}
+
+	sfp_header_t * sfp_header = csp_sfp_header_remove(packet);
+	const uint32_t totalsize = csp_ntoh32(sfp_header->totalsize);
+	const uint32_t crc = csp_sfp_checkpoint_crc(packet);
+	csp_buffer_free(packet);
+
+	if (totalsize == 0) {
+		return CSP_ERR_SFP;
+	}
+
+	/* A different transfer - start over */
+	if ((state->data == NULL) || (state->totalsize != totalsize) || (state->crc != crc)) {
+		csp_sfp_resume_free(state);
+		state->data = csp_malloc(totalsize);
+		if (state->data == NULL) {
+			csp_log_error("%s: failed to allocate %"PRIu32" bytes", __FUNCTION__, totalsize);
+			return CSP_ERR_NOMEM;
+		}
+		state->totalsize = totalsize;
+		state->crc = crc;
+	}
+
+	csp_log_protocol("%s: checkpoint %"PRIu32" of %"PRIu32, __FUNCTION__, state->offset, state->totalsize);
+
+	int error = csp_sfp_send_checkpoint(conn, state->offset, state->totalsize, state->crc);
+	if (error != CSP_ERR_NONE) {
+		return error;
+	}
+
+	while (state->offset < state->totalsize) {
+
+		if ((packet = csp_read(conn, timeout)) == NULL) {
+			return CSP_ERR_TIMEDOUT;
+		}
+
+		if (packet->length <= sizeof(sfp_header_t)) {
+			csp_log_error("%s: %u:%u, missing SFP data, length: %u",
+			              __FUNCTION__, packet->id.src, packet->id.sport, packet->length);
+			csp_buffer_free(packet);
+			continue;
+		}
+
+		sfp_header = csp_sfp_header_remove(packet);
+		const uint32_t offset = csp_ntoh32(sfp_header->offset);
+
+		/* Only extend the contiguous range, anything else is requested again on the next connection */
+		if ((offset != state->offset) ||
+		    (csp_ntoh32(sfp_header->totalsize) != state->totalsize) ||
+		    (packet->length > (state->totalsize - state->offset))) {
+			csp_log_warn("%s: %u:%u, dropping chunk at offset %"PRIu32", checkpoint %"PRIu32,
+			             __FUNCTION__, packet->id.src, packet->id.sport, offset, state->offset);
+			csp_buffer_free(packet);
+			continue;
+		}
+
+		memcpy(&state->data[state->offset], packet->data, packet->length);
+		state->offset += packet->length;
+		csp_buffer_free(packet);
+	}
+
+	return CSP_ERR_NONE;
+}
+
+void csp_sfp_resume_free(csp_sfp_resume_t * state) {
+
+	csp_free(state->data);
+	state->data = NULL;
+	state->totalsize = 0;
+	state->crc = 0;
+	state->offset = 0;
+}
+
+/**
+   NACK header, sent from csp_sfp_recv_window() to csp_sfp_send_window() (network byte order).
+   Followed by a bitmap of missing chunks, bit 0 of byte 0 is chunk \a base.
+*/
+typedef struct __attribute__((__packed__)) {
+	uint32_t totalsize;
+	uint32_t base;
+	uint8_t flags;
+} sfp_nack_t;
+
+/** NACK flag: all chunks received, transfer complete. */
+#define SFP_NACK_DONE		0x01
+/** NACK flag: chunk size not known yet, send all chunks again. */
+#define SFP_NACK_ALL		0x02
+
+/** Max attempts to get a buffer for a chunk, before giving up. Sleeps 1 ms between attempts. */
+#define SFP_WINDOW_NOMEM_RETRIES	100
+
+static inline bool csp_sfp_bitmap_get(const uint8_t * bitmap, uint32_t bit) {
+	return (bitmap[bit / 8] & (1 << (bit % 8))) != 0;
+}
+
+static inline void csp_sfp_bitmap_set(uint8_t * bitmap, uint32_t bit) {
+	bitmap[bit / 8] |= (1 << (bit % 8));
+}
+
+/**
+   Send chunk \a index, retrying while the buffer pool is exhausted by the burst.
+*/
+static int csp_sfp_window_send_chunk(csp_conn_t * conn, const uint8_t * data, uint32_t totalsize, uint32_t index, unsigned int mtu) {
+
+	const uint32_t offset = index * mtu;
+	const uint32_t size = ((totalsize - offset) > mtu) ? mtu : (totalsize - offset);
+
+	for (unsigned int retry = 0; ; ++retry) {
+		int error = csp_sfp_send_chunk(conn, data, totalsize, offset, size);
+		if ((error != CSP_ERR_NOMEM) || (retry >= SFP_WINDOW_NOMEM_RETRIES)) {
+			return error;
+		}
+		csp_sleep_ms(1);
+	}
+}
+
+int csp_sfp_send_window(csp_conn_t * conn, const void * data, unsigned int datasize, unsigned int mtu, uint32_t timeout) {
+
+	if ((mtu == 0) || (datasize == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	const uint32_t chunks = (datasize + mtu - 1) / mtu;
+	int error;
+
+	/* First round - everything */
+	for (uint32_t i = 0; i < chunks; ++i) {
+		if ((error = csp_sfp_window_send_chunk(conn, data, datasize, i, mtu)) != CSP_ERR_NONE) {
+			return error;
+		}
+	}
+
+	while (1) {
+
+		csp_packet_t * packet = csp_read(conn, timeout);
+		if (packet == NULL) {
+			return CSP_ERR_TIMEDOUT;
+		}
+
+		/* NACKs may have queued up while sending, only the newest is of interest */
+		csp_packet_t * newer;
+		while ((newer = csp_read(conn, 0)) != NULL) {
+			csp_buffer_free(packet);
+			packet = newer;
+		}
+
+		if (packet->length < sizeof(sfp_nack_t)) {
+			csp_log_error("%s: %u:%u, invalid NACK, length: %u",
+			              __FUNCTION__, packet->id.src, packet->id.sport, packet->length);
+			csp_buffer_free(packet);
+			return CSP_ERR_SFP;
+		}
+
+		const sfp_nack_t * nack = (const sfp_nack_t *) packet->data;
+		const uint32_t base = csp_ntoh32(nack->base);
+		const uint8_t * bitmap = &packet->data[sizeof(*nack)];
+		const uint32_t bits = (packet->length - sizeof(*nack)) * 8;
+
+		if (csp_ntoh32(nack->totalsize) != datasize) {
+			csp_log_error("%s: NACK for transfer size %"PRIu32", expected %u",
+			              __FUNCTION__, csp_ntoh32(nack->totalsize), datasize);
+			csp_buffer_free(packet);
+			return CSP_ERR_SFP;
+		}
+
+		if (nack->flags & SFP_NACK_DONE) {
+			csp_buffer_free(packet);
+			return CSP_ERR_NONE;
+		}
+
+		error = CSP_ERR_NONE;
+		for (uint32_t i = 0; (i < chunks) && (error == CSP_ERR_NONE); ++i) {
+			if ((nack->flags & SFP_NACK_ALL) ||
+			    ((i >= base) && ((i - base) < bits) && csp_sfp_bitmap_get(bitmap, i - base))) {
+				error = csp_sfp_window_send_chunk(conn, data, datasize, i, mtu);
+			}
+		}
+		csp_buffer_free(packet);
+
+		if (error != CSP_ERR_NONE) {
+			return error;
+		}
+	}
+}
+
+/**
+   Receive state for csp_sfp_recv_window().
+*/
+typedef struct {
+	uint8_t * data;
+	uint32_t totalsize;
+	/** Chunk size, learned from the first chunk that isn't the last one. 0 until known. */
+	uint32_t mtu;
+	uint32_t chunks;
+	uint32_t received;
+	/** Received chunks, allocated when \a mtu is known. */
+	uint8_t * bitmap;
+	/** Last chunk received before \a mtu was known. */
+	bool last_received;
+} sfp_window_t;
+
+static inline bool csp_sfp_window_complete(const sfp_window_t * w) {
+	return (w->chunks != 0) && (w->received == w->chunks);
+}
+
+/**
+   Mark chunk at \a offset received, returns true if it is new.
+*/
+static bool csp_sfp_window_mark(sfp_window_t * w, uint32_t offset, uint32_t size) {
+
+	const bool last = ((offset + size) == w->totalsize);
+
+	if ((w->mtu == 0) && !last) {
+		w->mtu = size;
+		w->chunks = (w->totalsize + w->mtu - 1) / w->mtu;
+		w->bitmap = csp_calloc(1, (w->chunks + 7) / 8);
+		if (w->bitmap == NULL) {
+			return false;
+		}
+		if (w->last_received) {
+			csp_sfp_bitmap_set(w->bitmap, w->chunks - 1);
+			w->received = 1;
+		}
+	}
+
+	if (w->mtu == 0) {
+		/* Only the last chunk seen so far - a single chunk transfer is complete */
+		bool new = !w->last_received;
+		w->last_received = true;
+		if (offset == 0) {
+			w->chunks = 1;
+			w->received = 1;
+		}
+		return new;
+	}
+
+	const uint32_t index = offset / w->mtu;
+	if (((offset % w->mtu) != 0) || (index >= w->chunks) || csp_sfp_bitmap_get(w->bitmap, index)) {
+		return false;
+	}
+	csp_sfp_bitmap_set(w->bitmap, index);
+	w->received++;
+	return true;
+}
+
+static int csp_sfp_window_send_nack(csp_conn_t * conn, const sfp_window_t * w) {
+
+	csp_packet_t * packet = csp_buffer_get(csp_buffer_data_size());
+	if (packet == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	sfp_nack_t * nack = (sfp_nack_t *) packet->data;
+	uint8_t * bitmap = &packet->data[sizeof(*nack)];
+	uint32_t base = 0;
+	uint32_t bytes = 0;
+
+	nack->totalsize = csp_hton32(w->totalsize);
+	nack->flags = 0;
+	if (csp_sfp_window_complete(w)) {
+		nack->flags = SFP_NACK_DONE;
+		base = w->chunks;
+	} else if (w->mtu == 0) {
+		nack->flags = SFP_NACK_ALL;
+	} else {
+		/* Missing chunks from the first missing one, as many as fits in a packet */
+		while (csp_sfp_bitmap_get(w->bitmap, base)) {
+			++base;
+		}
+		const uint32_t max_bits = (csp_buffer_data_size() - sizeof(*nack)) * 8;
+		for (uint32_t i = 0; (i < max_bits) && ((base + i) < w->chunks); ++i) {
+			if ((i % 8) == 0) {
+				bitmap[bytes++] = 0;
+			}
+			if (!csp_sfp_bitmap_get(w->bitmap, base + i)) {
+				csp_sfp_bitmap_set(bitmap, i);
+			}
+		}
+	}
+	nack->base = csp_hton32(base);
+	packet->length = sizeof(*nack) + bytes;
+
+	if (!csp_send(conn, packet, 0)) {
+		csp_buffer_free(packet);
+		return CSP_ERR_TX;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_sfp_recv_window(csp_conn_t * conn, void ** dataout, int * datasize, uint32_t nack_interval, uint32_t timeout, csp_packet_t * first_packet) {
+
+	*dataout = NULL;
+	*datasize = 0;
+
+	sfp_window_t w = {0};
+	int error = CSP_ERR_TIMEDOUT;
+	uint32_t last_rx = csp_get_ms();
+	uint32_t last_nack = last_rx;
+	csp_packet_t * packet;
+
+	while (1) {
+
+		uint32_t now = csp_get_ms();
+		if ((now - last_rx) >= timeout) {
+			csp_log_error("%s: timeout, received %"PRIu32" of %"PRIu32" chunks", __FUNCTION__, w.received, w.chunks);
+			break;
+		}
+
+		/* Wake up for the next NACK, unless still waiting for the first chunk */
+		uint32_t wait = timeout - (now - last_rx);
+		if (w.data != NULL) {
+			const uint32_t since_nack = now - last_nack;
+			const uint32_t to_nack = (since_nack < nack_interval) ? (nack_interval - since_nack) : 0;
+			if (to_nack < wait) {
+				wait = to_nack;
+			}
+		}
+
+		if ((packet = first_packet) != NULL) {
+			first_packet = NULL;
+		} else {
+			packet = csp_read(conn, wait);
+		}
+
+		if (packet != NULL) {
+
+			if (packet->length <= sizeof(sfp_header_t)) {
+				csp_log_error("%s: %u:%u, missing SFP data, length: %u",
+				              __FUNCTION__, packet->id.src, packet->id.sport, packet->length);
+				csp_buffer_free(packet);
+				continue;
+			}
+
+			sfp_header_t * sfp_header = csp_sfp_header_remove(packet);
+			const uint32_t offset = csp_ntoh32(sfp_header->offset);
+			const uint32_t totalsize = csp_ntoh32(sfp_header->totalsize);
+
+			if (w.data == NULL) {
+				if (totalsize == 0) {
+					csp_buffer_free(packet);
+					continue;
+				}
+				w.totalsize = totalsize;
+				w.data = csp_malloc(totalsize);
+				if (w.data == NULL) {
+					csp_log_error("%s: failed to allocate %"PRIu32" bytes", __FUNCTION__, totalsize);
+					csp_buffer_free(packet);
+					error = CSP_ERR_NOMEM;
+					break;
+				}
+			}
+
+			if ((totalsize != w.totalsize) || (offset >= w.totalsize) || (packet->length > (w.totalsize - offset))) {
+				csp_log_error("%s: %u:%u, invalid chunk, offset: %"PRIu32", length: %u, totalsize: %"PRIu32" (expected %"PRIu32")",
+				              __FUNCTION__, packet->id.src, packet->id.sport, offset, packet->length, totalsize, w.totalsize);
+				csp_buffer_free(packet);
+				continue;
+			}
+
+			if (csp_sfp_window_mark(&w, offset, packet->length)) {
+				memcpy(&w.data[offset], packet->data, packet->length);
+			} else if ((w.mtu != 0) && (w.bitmap == NULL)) {
+				csp_buffer_free(packet);
+				error = CSP_ERR_NOMEM;
+				break;
+			}
+			csp_buffer_free(packet);
+			last_rx = csp_get_ms();
+
+			if (csp_sfp_window_complete(&w)) {
+				error = CSP_ERR_NONE;
+				break;
+			}
+		}
+
+		if ((w.data != NULL) && ((csp_get_ms() - last_nack) >= nack_interval)) {
+			csp_sfp_window_send_nack(conn, &w);
+			last_nack = csp_get_ms();
+		}
+	}
+
+	if (error == CSP_ERR_NONE) {
+		/* Tell the sender we're done - and keep telling it, as long as it sends chunks (a NACK may be lost) */
+		do {
+			csp_sfp_window_send_nack(conn, &w);
+			if ((packet = csp_read(conn, nack_interval)) != NULL) {
+				csp_buffer_free(packet);
+			}
+		} while (packet != NULL);
+
+		*dataout = w.data;
+		*datasize = w.totalsize;
+	} else {
+		csp_free(w.data);
+	}
+	csp_free(w.bitmap);
+
+	return error;
+}
+
+/** Poll interval for striped receive workers, to notice when other connections completed the transfer. */
+#define SFP_STRIPE_POLL_MS	10
+
+/**
+   Shared state for striped send/receive.
+*/
+typedef struct {
+	csp_mutex_t lock;
+	/** Each worker enqueues its result (int) when done. */
+	csp_queue_handle_t done;
+	const uint8_t * tx_data;
+	uint32_t totalsize;
+	unsigned int mtu;
+	uint32_t timeout;
+	/** Tx: next chunk to send. */
+	uint32_t next;
+	/** Rx: received data and chunks, complete when every chunk has been received (duplicates are ignored). */
+	sfp_window_t rx;
+	int error;
+} sfp_stripe_t;
+
+typedef struct {
+	sfp_stripe_t * stripe;
+	csp_conn_t * conn;
+} sfp_stripe_worker_t;
+
+static CSP_DEFINE_TASK(csp_sfp_stripe_tx_task) {
+
+	sfp_stripe_worker_t * worker = param;
+	sfp_stripe_t * s = worker->stripe;
+	int error = CSP_ERR_NONE;
+
+	while (1) {
+		csp_mutex_lock(&s->lock, CSP_MAX_DELAY);
+		const uint32_t offset = s->next;
+		if ((offset < s->totalsize) && (s->error == CSP_ERR_NONE)) {
+			s->next = ((s->totalsize - offset) > s->mtu) ? (offset + s->mtu) : s->totalsize;
+		}
+		const uint32_t end = s->next;
+		const bool stop = (s->error != CSP_ERR_NONE);
+		csp_mutex_unlock(&s->lock);
+
+		if (stop || (offset >= end)) {
+			break;
+		}
+
+		if ((error = csp_sfp_send_chunk(worker->conn, s->tx_data, s->totalsize, offset, end - offset)) != CSP_ERR_NONE) {
+			csp_mutex_lock(&s->lock, CSP_MAX_DELAY);
+			s->error = error;
+			csp_mutex_unlock(&s->lock);
+			break;
+		}
+	}
+
+	csp_queue_enqueue(s->done, &error, CSP_MAX_DELAY);
+	return CSP_TASK_RETURN;
+}
+
+static CSP_DEFINE_TASK(csp_sfp_stripe_rx_task) {
+
+	sfp_stripe_worker_t * worker = param;
+	sfp_stripe_t * s = worker->stripe;
+	uint32_t last_rx = csp_get_ms();
+	int error = CSP_ERR_NONE;
+
+	while (1) {
+		csp_mutex_lock(&s->lock, CSP_MAX_DELAY);
+		const bool stop = (s->error != CSP_ERR_NONE) || csp_sfp_window_complete(&s->rx);
+		csp_mutex_unlock(&s->lock);
+		if (stop) {
+			break;
+		}
+
+		csp_packet_t * packet = csp_read(worker->conn, SFP_STRIPE_POLL_MS);
+		if (packet == NULL) {
+			if ((csp_get_ms() - last_rx) >= s->timeout) {
+				error = CSP_ERR_TIMEDOUT;
+				break;
+			}
+			continue;
+		}
+		last_rx = csp_get_ms();
+
+		if (packet->length <= sizeof(sfp_header_t)) {
+			csp_log_error("%s: %u:%u, missing SFP data, length: %u",
+			              __FUNCTION__, packet->id.src, packet->id.sport, packet->length);
+			csp_buffer_free(packet);
+			continue;
+		}
+
+		sfp_header_t * sfp_header = csp_sfp_header_remove(packet);
+		const uint32_t offset = csp_ntoh32(sfp_header->offset);
+		const uint32_t totalsize = csp_ntoh32(sfp_header->totalsize);
+
+		csp_mutex_lock(&s->lock, CSP_MAX_DELAY);
+		if (s->rx.data == NULL) {
+			if ((s->rx.data = csp_malloc(totalsize)) == NULL) {
+				csp_log_error("%s: failed to allocate %"PRIu32" bytes", __FUNCTION__, totalsize);
+				error = CSP_ERR_NOMEM;
+			}
+			s->rx.totalsize = totalsize;
+		}
+		if ((error == CSP_ERR_NONE) &&
+		    ((totalsize != s->rx.totalsize) || (offset >= totalsize) || (packet->length > (totalsize - offset)))) {
+			csp_log_error("%s: %u:%u, invalid chunk, offset: %"PRIu32", length: %u, totalsize: %"PRIu32" (expected %"PRIu32")",
+			              __FUNCTION__, packet->id.src, packet->id.sport, offset, packet->length, totalsize, s->rx.totalsize);
+			error = CSP_ERR_SFP;
+		}
+		if (error == CSP_ERR_NONE) {
+			if (csp_sfp_window_mark(&s->rx, offset, packet->length)) {
+				memcpy(&s->rx.data[offset], packet->data, packet->length);
+			} else if ((s->rx.mtu != 0) && (s->rx.bitmap == NULL)) {
+				error = CSP_ERR_NOMEM;
+			}
+		}
+		if (error != CSP_ERR_NONE) {
+			s->error = error;
+		}
+		csp_mutex_unlock(&s->lock);
+		csp_buffer_free(packet);
+
+		if (error != CSP_ERR_NONE) {
+			break;
+		}
+	}
+
+	csp_queue_enqueue(s->done, &error, CSP_MAX_DELAY);
+	return CSP_TASK_RETURN;
+}
+
+/**
+   Run \a task on each connection and wait for all to finish.
+*/
+static int csp_sfp_stripe_run(sfp_stripe_t * s, csp_thread_func_t task, csp_conn_t * conns[], unsigned int count) {
+
+	if (csp_mutex_create(&s->lock) != CSP_MUTEX_OK) {
+		return CSP_ERR_NOMEM;
+	}
+
+	sfp_stripe_worker_t * workers = csp_calloc(count, sizeof(*workers));
+	s->done = csp_queue_create(count, sizeof(int));
+	if ((workers == NULL) || (s->done == NULL)) {
+		csp_free(workers);
+		if (s->done) {
+			csp_queue_remove(s->done);
+		}
+		csp_mutex_remove(&s->lock);
+		return CSP_ERR_NOMEM;
+	}
+
+	unsigned int started = 0;
+	for (; started < count; ++started) {
+		workers[started].stripe = s;
+		workers[started].conn = conns[started];
+		if (csp_thread_create(task, "SFP", 0, &workers[started], 0, NULL) != CSP_ERR_NONE) {
+			/* Let the started workers finish */
+			csp_mutex_lock(&s->lock, CSP_MAX_DELAY);
+			s->error = CSP_ERR_NOMEM;
+			csp_mutex_unlock(&s->lock);
+			break;
+		}
+	}
+
+	int error = CSP_ERR_NONE;
+	for (unsigned int i = 0; i < started; ++i) {
+		int result;
+		csp_queue_dequeue(s->done, &result, CSP_MAX_DELAY);
+		if (error == CSP_ERR_NONE) {
+			error = result;
+		}
+	}
+	if (s->error != CSP_ERR_NONE) {
+		error = s->error;
+	}
+
+	csp_queue_remove(s->done);
+	csp_free(workers);
+	csp_mutex_remove(&s->lock);
+
+	return error;
+}
+
+int csp_sfp_send_striped(csp_conn_t * conns[], unsigned int count, const void * data, unsigned int datasize, unsigned int mtu, uint32_t timeout) {
+
+	if ((count == 0) || (mtu == 0) || (datasize == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	sfp_stripe_t s = {
+		.tx_data = data,
+		.totalsize = datasize,
+		.mtu = mtu,
+		.timeout = timeout,
+	};
+
+	return csp_sfp_stripe_run(&s, csp_sfp_stripe_tx_task, conns, count);
+}
+
+int csp_sfp_recv_striped(csp_conn_t * conns[], unsigned int count, void ** dataout, int * datasize, uint32_t timeout) {
+
+	*dataout = NULL;
+	*datasize = 0;
+
+	if (count == 0) {
+		return CSP_ERR_INVAL;
+	}
+
+	sfp_stripe_t s = {
+		.timeout = timeout,
+	};
+
+	int error = csp_sfp_stripe_run(&s, csp_sfp_stripe_rx_task, conns, count);
+
+	/* A connection may time out after the others completed the transfer */
+	csp_free(s.rx.bitmap);
+	if (csp_sfp_window_complete(&s.rx) && (error != CSP_ERR_NOMEM) && (error != CSP_ERR_SFP)) {
+		*dataout = s.rx.data;
+		*datasize = s.rx.totalsize;
+		return CSP_ERR_NONE;
+	}
+
+	csp_free(s.rx.data);
+	return (error != CSP_ERR_NONE) ? error : CSP_ERR_SFP;
+}
@@ -0,0 +1,119 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   Packet receive timestamps.
+
+   All received packets are passed to csp_qfifo_write() - from drivers, deframers in libcsp.so and the loopback
+   interface. csp_qfifo_write() is interposed here: packets get the receive timestamp set by the calling thread
+   (csp_rx_timestamp_set()), or have their timestamp cleared, as the padding may hold a timestamp from the previous
+   use of the buffer. The libcsp.so version is then called through dlsym(RTLD_NEXT).
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <csp/csp_timestamp.h>
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <csp/csp_interface.h>
+#include <csp/csp_debug.h>
+
+/** Layout of the timestamp in csp_packet_t::padding: nS, magic and source (low nibble) + clock (high nibble) */
+#define CSP_TIMESTAMP_MAGIC		0xA7
+#define CSP_TIMESTAMP_MAGIC_OFFSET	8
+#define CSP_TIMESTAMP_SOURCE_OFFSET	9
+#define CSP_TIMESTAMP_SOURCE_MASK	0x0F
+#define CSP_TIMESTAMP_CLOCK_SHIFT	4
+
+typedef void (*csp_qfifo_write_fnc_t)(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE * pxTaskWoken);
+
+/** libcsp.so function, set by csp_timestamp_init() */
+static csp_qfifo_write_fnc_t csp_qfifo_write_next;
+
+/** Receive timestamp of the calling (driver) thread */
+static __thread csp_rx_timestamp_t csp_rx_timestamp;
+
+__attribute__((constructor))
+static void csp_timestamp_init(void) {
+
+	csp_qfifo_write_next = (csp_qfifo_write_fnc_t) dlsym(RTLD_NEXT, "csp_qfifo_write");
+	if (csp_qfifo_write_next == NULL) {
+		/* Can't continue without libcsp.so */
+		abort();
+	}
+}
+
+bool csp_packet_get_rx_timestamp(const csp_packet_t * packet, csp_rx_timestamp_t * ts) {
+
+	if ((packet->padding[CSP_TIMESTAMP_MAGIC_OFFSET] != CSP_TIMESTAMP_MAGIC) ||
+	    ((packet->padding[CSP_TIMESTAMP_SOURCE_OFFSET] & CSP_TIMESTAMP_SOURCE_MASK) == CSP_TIMESTAMP_NONE)) {
+		memset(ts, 0, sizeof(*ts));
+		return false;
+	}
+
+	memcpy(&ts->ns, packet->padding, sizeof(ts->ns));
+	ts->source = packet->padding[CSP_TIMESTAMP_SOURCE_OFFSET] & CSP_TIMESTAMP_SOURCE_MASK;
+	ts->clock = packet->padding[CSP_TIMESTAMP_SOURCE_OFFSET] >> CSP_TIMESTAMP_CLOCK_SHIFT;
+	return true;
+}
+
+void csp_packet_set_rx_timestamp(csp_packet_t * packet, const csp_rx_timestamp_t * ts) {
+
+	if ((ts == NULL) || (ts->source == CSP_TIMESTAMP_NONE)) {
+		packet->padding[CSP_TIMESTAMP_MAGIC_OFFSET] = 0;
+		return;
+	}
+
+	memcpy(packet->padding, &ts->ns, sizeof(ts->ns));
+	packet->padding[CSP_TIMESTAMP_MAGIC_OFFSET] = CSP_TIMESTAMP_MAGIC;
+	packet->padding[CSP_TIMESTAMP_SOURCE_OFFSET] = (ts->source & CSP_TIMESTAMP_SOURCE_MASK) | (ts->clock << CSP_TIMESTAMP_CLOCK_SHIFT);
+}
+
+void csp_rx_timestamp_set(const csp_rx_timestamp_t * ts) {
+
+	if (ts) {
+		csp_rx_timestamp = *ts;
+	} else {
+		csp_rx_timestamp.source = CSP_TIMESTAMP_NONE;
+	}
+}
+
+void csp_timestamp_now(csp_rx_timestamp_t * ts) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ts->ns = ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+	ts->source = CSP_TIMESTAMP_DRIVER;
+	ts->clock = CSP_TIMESTAMP_CLOCK_MONOTONIC;
+}
+
+void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE * pxTaskWoken) {
+
+	if (packet) {
+		csp_packet_set_rx_timestamp(packet, &csp_rx_timestamp);
+	}
+	csp_qfifo_write_next(packet, iface, pxTaskWoken);
+}
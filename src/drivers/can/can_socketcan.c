@@ -0,0 +1,467 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   Socket CAN driver (Linux), with CAN FD support.
+
+   Replaces the driver in libcsp.so (same functions and behaviour for CAN 2.0), and adds
+   csp_can_socketcan_open_and_add_interface_fd(): the socket is opened with CAN_RAW_FD_FRAMES, and packets are fragmented into
+   CAN FD frames of up to 64 bytes (see csp_can_tx()).
+
+   Frames are sent with sendmmsg(), a burst of fragments per call (csp_can_interface_data_t::tx_burst_func), and received
+   with recvmmsg(), all queued frames per call, which are passed to csp_can_rx_burst().
+
+   Received frames are timestamped with SO_TIMESTAMPING - hardware timestamps if the device supports them, otherwise
+   kernel software timestamps (SO_TIMESTAMPNS on older kernels). See csp/csp_timestamp.h.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sendmmsg(), recvmmsg()
+#endif
+
+#include <csp/drivers/can_socketcan.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+#if (CSP_HAVE_LIBSOCKETCAN)
+#include <libsocketcan.h>
+#endif
+
+#include <csp/csp.h>
+#include <csp/csp_debug.h>
+#include <csp/arch/csp_thread.h>
+
+/** Time in mS to retry write(), when the device queue is full */
+#define SOCKETCAN_TX_RETRY_MS	1000
+
+/** Max frames received per recvmmsg() */
+#define SOCKETCAN_RX_BURST	32
+
+/** Control message space per frame, for struct scm_timestamping */
+#define SOCKETCAN_RX_CMSG_SIZE	CMSG_SPACE(3 * sizeof(struct timespec))
+
+typedef struct {
+	char name[CSP_IFLIST_NAME_MAX + 1];
+	csp_iface_t iface;
+	csp_can_interface_data_t ifdata;
+	pthread_t rx_thread;
+	int socket;
+	bool fd;
+} can_context_t;
+
+static void socketcan_free(can_context_t * ctx) {
+
+	if (ctx) {
+		if (ctx->socket >= 0) {
+			close(ctx->socket);
+		}
+		free(ctx);
+	}
+}
+
+/**
+   Get receive timestamp from control messages: hardware, kernel software or none.
+*/
+static void socketcan_rx_timestamp(struct msghdr * msg, csp_rx_timestamp_t * ts) {
+
+	ts->ns = 0;
+	ts->source = CSP_TIMESTAMP_NONE;
+	ts->clock = CSP_TIMESTAMP_CLOCK_REALTIME;
+
+	for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET) {
+			continue;
+		}
+		if (cmsg->cmsg_type == SO_TIMESTAMPING) {
+			/* ts[0]: software, ts[2]: raw hardware */
+			struct timespec stamps[3];
+			memcpy(stamps, CMSG_DATA(cmsg), sizeof(stamps));
+			if (stamps[2].tv_sec || stamps[2].tv_nsec) {
+				ts->ns = ((uint64_t) stamps[2].tv_sec * 1000000000) + (uint64_t) stamps[2].tv_nsec;
+				ts->source = CSP_TIMESTAMP_HARDWARE;
+				ts->clock = CSP_TIMESTAMP_CLOCK_DEVICE;
+			} else if (stamps[0].tv_sec || stamps[0].tv_nsec) {
+				ts->ns = ((uint64_t) stamps[0].tv_sec * 1000000000) + (uint64_t) stamps[0].tv_nsec;
+				ts->source = CSP_TIMESTAMP_KERNEL;
+			}
+		} else if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+			struct timespec stamp;
+			memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+			ts->ns = ((uint64_t) stamp.tv_sec * 1000000000) + (uint64_t) stamp.tv_nsec;
+			ts->source = CSP_TIMESTAMP_KERNEL;
+		}
+	}
+}
+
+/**
+   Enable receive timestamps: hardware and software with SO_TIMESTAMPING, or SO_TIMESTAMPNS.
+*/
+static void socketcan_enable_timestamps(can_context_t * ctx, const struct ifreq * ifr) {
+
+	/* Hardware timestamps must be enabled on the device, which may require increased OS privileges */
+	struct hwtstamp_config hwconfig = {.tx_type = HWTSTAMP_TX_OFF, .rx_filter = HWTSTAMP_FILTER_ALL};
+	struct ifreq hw_ifr = *ifr;
+	hw_ifr.ifr_data = (void *) &hwconfig;
+	if (ioctl(ctx->socket, SIOCSHWTSTAMP, &hw_ifr) < 0) {
+		csp_log_info("%s[%s]: no hardware timestamps, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+	}
+
+	const int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+	                  SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	if (setsockopt(ctx->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+		return;
+	}
+
+	const int enable = 1;
+	if (setsockopt(ctx->socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+		csp_log_warn("%s[%s]: setsockopt(SO_TIMESTAMPNS) failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+	}
+}
+
+static void * socketcan_rx_thread(void * arg) {
+
+	can_context_t * ctx = arg;
+
+	/* struct can_frame (CAN_MTU) has the same layout as the start of struct canfd_frame */
+	struct canfd_frame rx_frames[SOCKETCAN_RX_BURST];
+	struct iovec iov[SOCKETCAN_RX_BURST];
+	struct mmsghdr msgs[SOCKETCAN_RX_BURST];
+	union {
+		uint8_t buf[SOCKETCAN_RX_CMSG_SIZE];
+		struct cmsghdr align;
+	} cmsg[SOCKETCAN_RX_BURST];
+	csp_can_frame_t frames[SOCKETCAN_RX_BURST];
+
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned int i = 0; i < SOCKETCAN_RX_BURST; i++) {
+		iov[i].iov_base = &rx_frames[i];
+		iov[i].iov_len = ctx->fd ? CANFD_MTU : CAN_MTU;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = cmsg[i].buf;
+	}
+
+	while (1) {
+		/* Control length is updated on return */
+		for (unsigned int i = 0; i < SOCKETCAN_RX_BURST; i++) {
+			msgs[i].msg_hdr.msg_controllen = sizeof(cmsg[i].buf);
+		}
+
+		/* Wait for at least one frame, and take all frames already queued */
+		const int received = recvmmsg(ctx->socket, msgs, SOCKETCAN_RX_BURST, MSG_WAITFORONE, NULL);
+		if (received < 0) {
+			csp_log_error("%s[%s]: recvmmsg() failed, errno %d: %s", __FUNCTION__, ctx->name, errno, strerror(errno));
+			continue;
+		}
+
+		unsigned int count = 0;
+		for (int i = 0; i < received; i++) {
+			struct canfd_frame * frame = &rx_frames[i];
+			const unsigned int nbytes = msgs[i].msg_len;
+
+			if ((nbytes != CAN_MTU) && (nbytes != CANFD_MTU)) {
+				csp_log_warn("%s[%s]: Read incomplete CAN frame, size: %u, expected: %u bytes", __FUNCTION__, ctx->name, nbytes, (unsigned int)(ctx->fd ? CANFD_MTU : CAN_MTU));
+				continue;
+			}
+
+			/* Drop frames with standard id (CSP uses extended) */
+			if (!(frame->can_id & CAN_EFF_FLAG)) {
+				continue;
+			}
+
+			/* Drop error and remote frames */
+			if (frame->can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)) {
+				csp_log_warn("%s[%s]: discarding ERR/RTR/SFF frame", __FUNCTION__, ctx->name);
+				continue;
+			}
+
+			/* Strip flags */
+			frames[count].id = frame->can_id & CAN_EFF_MASK;
+			frames[count].dlc = (frame->len <= CANFD_MAX_DLEN) ? frame->len : CANFD_MAX_DLEN;
+			memcpy(frames[count].data, frame->data, frames[count].dlc);
+			socketcan_rx_timestamp(&msgs[i].msg_hdr, &frames[count].timestamp);
+			count++;
+		}
+
+		if (count) {
+			csp_can_rx_burst(&ctx->iface, frames, count, NULL);
+		}
+	}
+
+	/* We should never reach this point */
+	pthread_exit(NULL);
+}
+
+/**
+   Round up to a valid CAN FD data length: 0 - 8, 12, 16, 20, 24, 32, 48 or 64.
+*/
+static uint8_t socketcan_fd_len(uint8_t len) {
+
+	static const uint8_t valid[] = {12, 16, 20, 24, 32, 48, 64};
+	if (len <= CAN_MAX_DLEN) {
+		return len;
+	}
+	for (unsigned int i = 0; i < sizeof(valid); i++) {
+		if (len <= valid[i]) {
+			return valid[i];
+		}
+	}
+	return CANFD_MAX_DLEN;
+}
+
+/**
+   Fill socketcan frame. Classic frames are written as struct can_frame (CAN_MTU), FD frames are padded with zeros.
+*/
+static void socketcan_make_frame(const can_context_t * ctx, struct canfd_frame * frame, uint32_t id, const uint8_t * data, uint8_t dlc) {
+
+	memset(frame, 0, sizeof(*frame));
+	frame->can_id = id | CAN_EFF_FLAG;
+	frame->len = ctx->fd ? socketcan_fd_len(dlc) : dlc;
+	frame->flags = ctx->fd ? CANFD_BRS : 0;
+	memcpy(frame->data, data, dlc);
+}
+
+static int csp_can_tx_frame(void * driver_data, uint32_t id, const uint8_t * data, uint8_t dlc) {
+
+	can_context_t * ctx = driver_data;
+
+	if (dlc > ctx->ifdata.frame_size) {
+		return CSP_ERR_INVAL;
+	}
+
+	struct canfd_frame frame;
+	socketcan_make_frame(ctx, &frame, id, data, dlc);
+	const int mtu = ctx->fd ? CANFD_MTU : CAN_MTU;
+
+	uint32_t elapsed_ms = 0;
+	while (write(ctx->socket, &frame, mtu) != mtu) {
+		if ((errno != ENOBUFS) || (elapsed_ms >= SOCKETCAN_TX_RETRY_MS)) {
+			csp_log_warn("%s[%s]: write() failed, errno %d: %s", __FUNCTION__, ctx->name, errno, strerror(errno));
+			return CSP_ERR_TX;
+		}
+		csp_sleep_ms(5);
+		elapsed_ms += 5;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+static int csp_can_tx_burst(void * driver_data, const csp_can_frame_t * frames, unsigned int count) {
+
+	can_context_t * ctx = driver_data;
+
+	if (count > CSP_CAN_TX_BURST) {
+		return CSP_ERR_INVAL;
+	}
+
+	struct canfd_frame tx_frames[CSP_CAN_TX_BURST];
+	struct iovec iov[CSP_CAN_TX_BURST];
+	struct mmsghdr msgs[CSP_CAN_TX_BURST];
+	memset(msgs, 0, count * sizeof(msgs[0]));
+	for (unsigned int i = 0; i < count; i++) {
+		if (frames[i].dlc > ctx->ifdata.frame_size) {
+			return CSP_ERR_INVAL;
+		}
+		socketcan_make_frame(ctx, &tx_frames[i], frames[i].id, frames[i].data, frames[i].dlc);
+		iov[i].iov_base = &tx_frames[i];
+		iov[i].iov_len = ctx->fd ? CANFD_MTU : CAN_MTU;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	/* sendmmsg() stops at the first frame the device queue can't take, continue from there */
+	unsigned int sent = 0;
+	uint32_t elapsed_ms = 0;
+	while (sent < count) {
+		const int res = sendmmsg(ctx->socket, &msgs[sent], count - sent, 0);
+		if (res > 0) {
+			sent += res;
+			continue;
+		}
+		if ((errno != ENOBUFS) || (elapsed_ms >= SOCKETCAN_TX_RETRY_MS)) {
+			csp_log_warn("%s[%s]: sendmmsg() failed, errno %d: %s", __FUNCTION__, ctx->name, errno, strerror(errno));
+			return CSP_ERR_TX;
+		}
+		csp_sleep_ms(5);
+		elapsed_ms += 5;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+static int socketcan_open_and_add_interface(const char * device, const char * ifname, int bitrate, bool promisc, bool fd, csp_iface_t ** return_iface) {
+
+	if (ifname == NULL) {
+		ifname = CSP_IF_CAN_DEFAULT_NAME;
+	}
+
+	csp_log_info("INIT %s: device: [%s], bitrate: %d, promisc: %d, fd: %d", ifname, device, bitrate, promisc, fd);
+
+#if (CSP_HAVE_LIBSOCKETCAN)
+	/* Set interface up - this may require increased OS privileges */
+	if (bitrate > 0) {
+		can_do_stop(device);
+		can_set_bitrate(device, bitrate);
+		can_set_restart_ms(device, 100);
+		can_do_start(device);
+	}
+#endif
+
+	can_context_t * ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+	ctx->socket = -1;
+	ctx->fd = fd;
+
+	strncpy(ctx->name, ifname, sizeof(ctx->name) - 1);
+	ctx->iface.name = ctx->name;
+	ctx->iface.interface_data = &ctx->ifdata;
+	ctx->iface.driver_data = ctx;
+	ctx->ifdata.tx_func = csp_can_tx_frame;
+	ctx->ifdata.tx_burst_func = csp_can_tx_burst;
+	ctx->ifdata.frame_size = fd ? CSP_CANFD_FRAME_SIZE : CSP_CAN_FRAME_SIZE;
+
+	/* Create socket */
+	if ((ctx->socket = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		csp_log_error("%s[%s]: socket() failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+		socketcan_free(ctx);
+		return CSP_ERR_INVAL;
+	}
+
+	/* Locate interface */
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+	if (ioctl(ctx->socket, SIOCGIFINDEX, &ifr) < 0) {
+		csp_log_error("%s[%s]: device: [%s], ioctl() failed, error: %s", __FUNCTION__, ctx->name, device, strerror(errno));
+		socketcan_free(ctx);
+		return CSP_ERR_INVAL;
+	}
+
+	if (fd) {
+		/* The device must support CAN FD frames */
+		struct ifreq mtu_ifr = ifr;
+		if ((ioctl(ctx->socket, SIOCGIFMTU, &mtu_ifr) < 0) || (mtu_ifr.ifr_mtu != CANFD_MTU)) {
+			csp_log_error("%s[%s]: device: [%s] is not configured for CAN FD", __FUNCTION__, ctx->name, device);
+			socketcan_free(ctx);
+			return CSP_ERR_DRIVER;
+		}
+		const int enable = 1;
+		if (setsockopt(ctx->socket, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)) < 0) {
+			csp_log_error("%s[%s]: setsockopt(CAN_RAW_FD_FRAMES) failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+			socketcan_free(ctx);
+			return CSP_ERR_DRIVER;
+		}
+	}
+
+	socketcan_enable_timestamps(ctx, &ifr);
+
+	/* Bind the socket to CAN interface */
+	struct sockaddr_can addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	if (bind(ctx->socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		csp_log_error("%s[%s]: bind() failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+		socketcan_free(ctx);
+		return CSP_ERR_INVAL;
+	}
+
+	/* Set filter mode */
+	if (promisc == false) {
+		struct can_filter filter = {.can_id = CFP_MAKE_DST(csp_get_address()), .can_mask = CFP_MAKE_DST((1 << CFP_HOST_SIZE) - 1)};
+		if (setsockopt(ctx->socket, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)) < 0) {
+			csp_log_error("%s[%s]: setsockopt() failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+			socketcan_free(ctx);
+			return CSP_ERR_INVAL;
+		}
+	}
+
+	/* Add interface to CSP */
+	int res = csp_can_add_interface(&ctx->iface);
+	if (res != CSP_ERR_NONE) {
+		csp_log_error("%s[%s]: csp_can_add_interface() failed, error: %d", __FUNCTION__, ctx->name, res);
+		socketcan_free(ctx);
+		return res;
+	}
+
+	/* Create receive thread */
+	if (pthread_create(&ctx->rx_thread, NULL, socketcan_rx_thread, ctx) != 0) {
+		csp_log_error("%s[%s]: pthread_create() failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+		// socketcan_free(ctx); // we already added it to CSP (no way to remove it)
+		return CSP_ERR_NOMEM;
+	}
+
+	if (return_iface) {
+		*return_iface = &ctx->iface;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_can_socketcan_open_and_add_interface(const char * device, const char * ifname, int bitrate, bool promisc, csp_iface_t ** return_iface) {
+	return socketcan_open_and_add_interface(device, ifname, bitrate, promisc, false, return_iface);
+}
+
+int csp_can_open_and_add_interface(const char * device, const char * ifname, int bitrate, bool promisc, csp_iface_t ** return_iface) {
+	return socketcan_open_and_add_interface(device, ifname, bitrate, promisc, false, return_iface);
+}
+
+int csp_can_socketcan_open_and_add_interface_fd(const char * device, const char * ifname, int bitrate, bool promisc, csp_iface_t ** return_iface) {
+	return socketcan_open_and_add_interface(device, ifname, bitrate, promisc, true, return_iface);
+}
+
+csp_iface_t * csp_can_socketcan_init(const char * device, int bitrate, bool promisc) {
+
+	csp_iface_t * return_iface;
+	int res = csp_can_socketcan_open_and_add_interface(device, CSP_IF_CAN_DEFAULT_NAME, bitrate, promisc, &return_iface);
+	return (res == CSP_ERR_NONE) ? return_iface : NULL;
+}
+
+int csp_can_socketcan_stop(csp_iface_t * iface) {
+
+	can_context_t * ctx = iface->driver_data;
+
+	int error = pthread_cancel(ctx->rx_thread);
+	if (error != 0) {
+		csp_log_error("%s[%s]: pthread_cancel() failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+		return CSP_ERR_DRIVER;
+	}
+	error = pthread_join(ctx->rx_thread, NULL);
+	if (error != 0) {
+		csp_log_error("%s[%s]: pthread_join() failed, error: %s", __FUNCTION__, ctx->name, strerror(errno));
+		return CSP_ERR_DRIVER;
+	}
+	socketcan_free(ctx);
+
+	return CSP_ERR_NONE;
+}
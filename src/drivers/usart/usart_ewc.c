@@ -0,0 +1,57 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   USART EWC interface: csp_usart_open_and_add_ewc_interface(), replaces the version in libcsp.so (see usart_iface.h).
+*/
+
+#include "usart_iface.h"
+
+#include <csp/arch/csp_malloc.h>
+
+typedef struct {
+	usart_iface_t usart;
+	csp_ewc_interface_data_t ifdata;
+} ewc_context_t;
+
+static bool ewc_rx_reset(csp_iface_t * iface) {
+
+	csp_ewc_interface_data_t * ifdata = iface->interface_data;
+	const bool started = (ifdata->rx_mode != EWC_MODE_NOT_STARTED);
+	ifdata->rx_mode = EWC_MODE_NOT_STARTED;
+	return started;
+}
+
+int csp_usart_open_and_add_ewc_interface(const csp_usart_conf_t *conf, const char * ifname, csp_iface_t ** return_iface) {
+
+	if (ifname == NULL) {
+		ifname = CSP_IF_EWC_DEFAULT_NAME;
+	}
+
+	ewc_context_t * ctx = csp_calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	ctx->ifdata.tx_func = usart_iface_tx;
+	ctx->ifdata.txv_func = usart_iface_txv;
+
+	return usart_iface_open(&ctx->usart, conf, ifname, &ctx->ifdata, csp_ewc_add_interface, csp_ewc_rx, ewc_rx_reset, return_iface);
+}
@@ -0,0 +1,95 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef _USART_IFACE_H_
+#define _USART_IFACE_H_
+
+/**
+   @file
+
+   CSP interfaces on an USART (Linux).
+
+   The KISS, EWC and MS200 interfaces (usart_kiss.c, usart_ewc.c, usart_ms200.c) only differ in their interface data and Rx
+   function. Adding the interface, opening the device, Tx and the handling of device failures is shared, in usart_linux.c.
+*/
+
+#include <csp/drivers/usart.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Rx function of the interface, e.g. csp_kiss_rx().
+*/
+typedef void (*usart_iface_rx_t)(csp_iface_t * iface, const uint8_t * buf, size_t len, void * pxTaskWoken);
+
+/**
+   Reset the Rx state of the interface, after a device failure.
+   @return true if a frame was being received (and is lost).
+*/
+typedef bool (*usart_iface_rx_reset_t)(csp_iface_t * iface);
+
+/**
+   CSP interface on an USART. Allocated by the interface, together with its interface data.
+*/
+typedef struct {
+    char name[CSP_IFLIST_NAME_MAX + 1];
+    csp_iface_t iface;
+    csp_usart_fd_t fd;
+    usart_iface_rx_t rx;
+    usart_iface_rx_reset_t rx_reset;
+} usart_iface_t;
+
+/**
+   Tx function for the interface data (tx_func).
+   @param[in] driver_data the #usart_iface_t.
+*/
+int usart_iface_tx(void * driver_data, const uint8_t * data, size_t len);
+
+/**
+   Vectored Tx function for the interface data (txv_func), the frame is written with one csp_usart_writev().
+   @param[in] driver_data the #usart_iface_t.
+*/
+int usart_iface_txv(void * driver_data, const csp_iovec_t * iov, unsigned int iovcnt);
+
+/**
+   Add CSP interface and open the device.
+
+   Device failures are counted in the interface rx_error (and frame, if a frame was being received), while the driver
+   reopens the device.
+
+   @param[in] ctx USART interface, zero initialized.
+   @param[in] conf USART configuration.
+   @param[in] ifname interface name.
+   @param[in] interface_data interface data, with tx_func/txv_func set to usart_iface_tx()/usart_iface_txv().
+   @param[in] add_interface function adding the interface, e.g. csp_kiss_add_interface().
+   @param[in] rx Rx function.
+   @param[in] rx_reset Rx reset function.
+   @param[out] return_iface the added interface, also if opening the device failed.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int usart_iface_open(usart_iface_t * ctx, const csp_usart_conf_t * conf, const char * ifname, void * interface_data,
+                     int (*add_interface)(csp_iface_t * iface), usart_iface_rx_t rx, usart_iface_rx_reset_t rx_reset,
+                     csp_iface_t ** return_iface);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,530 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   USART driver (Linux).
+
+   Replaces csp_usart_open() and csp_usart_write() in libcsp.so (csp_usart_open_and_add_*_interface() call them through the
+   PLT). Any number of devices can be open - one Rx thread serves all of them with epoll, instead of a blocking thread per
+   device. The Rx thread timestamps the data from each read(), and sets it as receive timestamp (csp_rx_timestamp_set())
+   for the packets completed by the Rx callback - see csp/csp_timestamp.h.
+
+   csp_usart_writev() sends a frame with one writev(), used by the vectored Tx function of the KISS, EWC and MS200 interfaces.
+   Their device handling is shared in usart_iface_open() - see usart_iface.h.
+*/
+
+#include <csp/drivers/usart.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/serial.h>
+
+#include <csp/csp_debug.h>
+#include <csp/csp_timestamp.h>
+#include <csp/arch/csp_thread.h>
+
+#include "usart_iface.h"
+#include "usart_linux_baud.h"
+
+/** Default Rx buffer size (bytes per read()) */
+#define USART_RX_BUF_SIZE	400
+
+/* csp_iovec_t is passed to writev() as is */
+_Static_assert(sizeof(csp_iovec_t) == sizeof(struct iovec), "csp_iovec_t must match struct iovec");
+_Static_assert(offsetof(csp_iovec_t, base) == offsetof(struct iovec, iov_base), "csp_iovec_t must match struct iovec");
+_Static_assert(offsetof(csp_iovec_t, len) == offsetof(struct iovec, iov_len), "csp_iovec_t must match struct iovec");
+
+/** Max number of ready devices handled per epoll_wait() */
+#define USART_RX_EVENTS		16
+
+/** Delay before the first reopen of a failed device, doubled on each failed attempt up to USART_REOPEN_MAX_MS */
+#define USART_REOPEN_MIN_MS	100
+#define USART_REOPEN_MAX_MS	5000
+
+typedef struct usart_context_s {
+	csp_usart_callback_t rx_callback;
+	csp_usart_error_callback_t error_callback;
+	void * user_data;
+	csp_usart_fd_t fd;
+	/** Configuration (with a copy of the device name), for reopening */
+	csp_usart_conf_t conf;
+	/** Max bytes per callback */
+	size_t rx_chunk_size;
+	/** Inter-byte gap (uS), 0 = one read() per wakeup */
+	uint32_t rx_gap_us;
+	uint8_t * rx_buf;
+	/** Failed device: time of next reopen attempt (mS), current backoff and next failed device */
+	uint64_t reopen_time;
+	uint32_t reopen_delay;
+	struct usart_context_s * next_failed;
+} usart_context_t;
+
+/**
+   Read available data into the context Rx buffer - and with an inter-byte gap, keep reading while more data arrives
+   within the gap.
+   @return number of bytes read, or the failing read() result.
+*/
+static int usart_rx_read(usart_context_t * ctx) {
+
+	int length = read(ctx->fd, ctx->rx_buf, ctx->rx_chunk_size);
+	if ((length <= 0) || (ctx->rx_gap_us == 0)) {
+		return length;
+	}
+
+	const int timeout_ms = (ctx->rx_gap_us + 999) / 1000;
+	while ((size_t) length < ctx->rx_chunk_size) {
+		struct pollfd pfd = {.fd = ctx->fd, .events = POLLIN};
+		if (poll(&pfd, 1, timeout_ms) <= 0) {
+			break;
+		}
+		int more = read(ctx->fd, ctx->rx_buf + length, ctx->rx_chunk_size - length);
+		if (more <= 0) {
+			break;
+		}
+		length += more;
+	}
+	return length;
+}
+
+/** Rx thread shared by all open devices, created on first csp_usart_open() with a callback */
+static pthread_once_t usart_rx_once = PTHREAD_ONCE_INIT;
+static int usart_epoll_fd = -1;
+
+/** Failed devices waiting to be reopened, only accessed by the Rx thread */
+static usart_context_t * usart_failed;
+
+static int usart_open_device(const csp_usart_conf_t * conf);
+
+static uint64_t usart_now_ms(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**
+   Take a failed device out of the Rx thread, and schedule reopening.
+
+   The file descriptor is kept open, so the number stays reserved - writes fail until the device has been reopened
+   onto it with dup2(). The interface stays registered.
+*/
+static void usart_rx_failed(usart_context_t * ctx, int error) {
+
+	csp_log_warn("%s: device: [%s] failed, errno: %s - reopening", __FUNCTION__, ctx->conf.device, strerror(error));
+
+	epoll_ctl(usart_epoll_fd, EPOLL_CTL_DEL, ctx->fd, NULL);
+	if (ctx->error_callback) {
+		ctx->error_callback(ctx->user_data, error);
+	}
+
+	ctx->reopen_delay = USART_REOPEN_MIN_MS;
+	ctx->reopen_time = usart_now_ms() + ctx->reopen_delay;
+	ctx->next_failed = usart_failed;
+	usart_failed = ctx;
+}
+
+/**
+   Try to reopen failed devices which are due.
+   @return time to next attempt (mS), -1 if no devices are waiting.
+*/
+static int usart_rx_reopen(void) {
+
+	const uint64_t now = usart_now_ms();
+	int timeout = -1;
+	for (usart_context_t ** pctx = &usart_failed; *pctx; ) {
+		usart_context_t * ctx = *pctx;
+		if (ctx->reopen_time <= now) {
+			int fd = usart_open_device(&ctx->conf);
+			if (fd >= 0) {
+				struct epoll_event event = {.events = EPOLLIN, .data.ptr = ctx};
+				if ((dup2(fd, ctx->fd) >= 0) && (epoll_ctl(usart_epoll_fd, EPOLL_CTL_ADD, ctx->fd, &event) == 0)) {
+					close(fd);
+					csp_log_info("%s: device: [%s] reopened", __FUNCTION__, ctx->conf.device);
+					*pctx = ctx->next_failed;
+					continue;
+				}
+				close(fd);
+			}
+			ctx->reopen_delay = ((ctx->reopen_delay * 2) < USART_REOPEN_MAX_MS) ? (ctx->reopen_delay * 2) : USART_REOPEN_MAX_MS;
+			ctx->reopen_time = now + ctx->reopen_delay;
+		}
+		const int wait = ctx->reopen_time - now;
+		if ((timeout < 0) || (wait < timeout)) {
+			timeout = wait;
+		}
+		pctx = &ctx->next_failed;
+	}
+	return timeout;
+}
+
+static void * usart_rx_thread(void * arg) {
+
+	struct epoll_event events[USART_RX_EVENTS];
+
+	// Receive loop
+	while (1) {
+		int count = epoll_wait(usart_epoll_fd, events, USART_RX_EVENTS, usart_rx_reopen());
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			csp_log_error("%s: epoll_wait() failed, errno: %s", __FUNCTION__, strerror(errno));
+			exit(1);
+		}
+
+		for (int i = 0; i < count; i++) {
+			usart_context_t * ctx = events[i].data.ptr;
+
+			/* Level triggered - one read per device per wakeup, so a busy device can't starve the others */
+			int length = usart_rx_read(ctx);
+			if (length < 0) {
+				if ((errno == EINTR) || (errno == EAGAIN)) {
+					continue;
+				}
+				usart_rx_failed(ctx, errno);
+				continue;
+			}
+			if (length == 0) {
+				/* Hangup, e.g. USB serial converter removed */
+				usart_rx_failed(ctx, EIO);
+				continue;
+			}
+
+			csp_rx_timestamp_t ts;
+			csp_timestamp_now(&ts);
+			csp_rx_timestamp_set(&ts);
+
+			ctx->rx_callback(ctx->user_data, ctx->rx_buf, length, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+static void usart_rx_init(void) {
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		csp_log_error("%s: epoll_create1() failed, errno: %s", __FUNCTION__, strerror(errno));
+		return;
+	}
+
+	usart_epoll_fd = epfd;
+
+	csp_thread_handle_t handle;
+	if (csp_thread_create(usart_rx_thread, "usart_rx", 0, NULL, 0, &handle) != CSP_ERR_NONE) {
+		csp_log_error("%s: csp_thread_create() failed to create Rx thread, errno: %s", __FUNCTION__, strerror(errno));
+		usart_epoll_fd = -1;
+		close(epfd);
+	}
+}
+
+int csp_usart_write(csp_usart_fd_t fd, const void * data, size_t data_length) {
+
+	if (fd >= 0) {
+		int res = write(fd, data, data_length);
+		if (res >= 0) {
+			return res;
+		}
+	}
+	return CSP_ERR_TX; // best matching CSP error code.
+}
+
+int csp_usart_writev(csp_usart_fd_t fd, const csp_iovec_t * iov, unsigned int iovcnt) {
+
+	if ((fd < 0) || (iovcnt > UIO_MAXIOV)) {
+		return CSP_ERR_TX;
+	}
+
+	size_t total = 0;
+	while (iovcnt) {
+		ssize_t res = writev(fd, (const struct iovec *) iov, iovcnt);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return CSP_ERR_TX;
+		}
+		total += res;
+
+		/* Skip the buffers written completely */
+		while (iovcnt && ((size_t) res >= iov->len)) {
+			res -= iov->len;
+			iov++;
+			iovcnt--;
+		}
+
+		/* Complete a partially written buffer, before continuing with the rest of the list */
+		if (res) {
+			const uint8_t * data = (const uint8_t *) iov->base + res;
+			size_t remain = iov->len - res;
+			while (remain) {
+				ssize_t w = write(fd, data, remain);
+				if (w < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					return CSP_ERR_TX;
+				}
+				data += w;
+				remain -= w;
+				total += w;
+			}
+			iov++;
+			iovcnt--;
+		}
+	}
+
+	return total;
+}
+
+/**
+   Open and configure device.
+   @return file descriptor, or a (negative) CSP error code.
+*/
+static int usart_open_device(const csp_usart_conf_t * conf) {
+
+	int brate = 0;
+	bool custom_baudrate = false;
+	switch(conf->baudrate) {
+		case 4800:    brate=B4800;    break;
+		case 9600:    brate=B9600;    break;
+		case 19200:   brate=B19200;   break;
+		case 38400:   brate=B38400;   break;
+		case 57600:   brate=B57600;   break;
+		case 115200:  brate=B115200;  break;
+		case 230400:  brate=B230400;  break;
+		case 460800:  brate=B460800;  break;
+		case 500000:  brate=B500000;  break;
+		case 576000:  brate=B576000;  break;
+		case 921600:  brate=B921600;  break;
+		case 1000000: brate=B1000000; break;
+		case 1152000: brate=B1152000; break;
+		case 1500000: brate=B1500000; break;
+		case 2000000: brate=B2000000; break;
+		case 2500000: brate=B2500000; break;
+		case 3000000: brate=B3000000; break;
+		case 3500000: brate=B3500000; break;
+		case 4000000: brate=B4000000; break;
+		default:
+			/* Set with termios2 after the other attributes */
+			if (conf->baudrate == 0) {
+				csp_log_error("%s: Unsupported baudrate: %u", __FUNCTION__, conf->baudrate);
+				return CSP_ERR_INVAL;
+			}
+			brate=B38400;
+			custom_baudrate = true;
+			break;
+	}
+
+	int fd = open(conf->device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0) {
+		csp_log_error("%s: failed to open device: [%s], errno: %s", __FUNCTION__, conf->device, strerror(errno));
+		return CSP_ERR_INVAL;
+	}
+
+	struct termios options;
+	tcgetattr(fd, &options);
+	cfsetispeed(&options, brate);
+	cfsetospeed(&options, brate);
+	options.c_cflag |= (CLOCAL | CREAD);
+	if (conf->paritysetting) {
+		/* Even parity */
+		options.c_cflag &= ~PARODD;
+		options.c_cflag |= PARENB;
+	} else {
+		options.c_cflag &= ~PARENB;
+	}
+	options.c_cflag &= ~(CSIZE | CSTOPB);
+	options.c_cflag |= CS8;
+	options.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+	options.c_iflag &= ~(IGNBRK | BRKINT | ICRNL | INLCR | PARMRK | INPCK | ISTRIP | IXON);
+	options.c_oflag &= ~(OCRNL | ONLCR | ONLRET | ONOCR | OFILL | OPOST);
+	options.c_cc[VTIME] = conf->vtime;
+	options.c_cc[VMIN] = conf->vmin ? conf->vmin : 1;
+	/* tcsetattr() succeeds if just one attribute was changed, should read back attributes and check all has been changed */
+	if (tcsetattr(fd, TCSANOW, &options) != 0) {
+		csp_log_error("%s: Failed to set attributes on device: [%s], errno: %s", __FUNCTION__, conf->device, strerror(errno));
+		close(fd);
+		return CSP_ERR_DRIVER;
+	}
+	if (custom_baudrate && (usart_set_custom_baudrate(fd, conf->baudrate) != 0)) {
+		csp_log_error("%s: Unsupported baudrate: %u on device: [%s], errno: %s", __FUNCTION__, conf->baudrate, conf->device, strerror(errno));
+		close(fd);
+		return CSP_ERR_INVAL;
+	}
+	if (conf->low_latency) {
+		/* Best effort - not all drivers support it (e.g. USB serial converters, pty) */
+		struct serial_struct serial;
+		int res = ioctl(fd, TIOCGSERIAL, &serial);
+		if (res == 0) {
+			serial.flags |= ASYNC_LOW_LATENCY;
+			res = ioctl(fd, TIOCSSERIAL, &serial);
+		}
+		if (res != 0) {
+			csp_log_warn("%s: Failed to set low latency on device: [%s], errno: %s", __FUNCTION__, conf->device, strerror(errno));
+		}
+	}
+	fcntl(fd, F_SETFL, 0);
+
+	/* Flush old transmissions */
+	if (tcflush(fd, TCIOFLUSH) != 0) {
+		csp_log_error("%s: Error flushing device: [%s], errno: %s", __FUNCTION__, conf->device, strerror(errno));
+		close(fd);
+		return CSP_ERR_DRIVER;
+	}
+
+	return fd;
+}
+
+int csp_usart_open(const csp_usart_conf_t *conf, csp_usart_callback_t rx_callback, void * user_data, csp_usart_fd_t * return_fd) {
+
+	if (return_fd) {
+		*return_fd = -1;
+	}
+
+	/* The device is read with a blocking read() by the Rx thread shared by all devices - VMIN without VTIME could block it forever */
+	if (rx_callback && (conf->vmin > 1) && (conf->vtime == 0)) {
+		csp_log_error("%s: vmin: %u requires vtime, device: [%s]", __FUNCTION__, conf->vmin, conf->device);
+		return CSP_ERR_INVAL;
+	}
+
+	int fd = usart_open_device(conf);
+	if (fd < 0) {
+		return fd;
+	}
+
+	usart_context_t * ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		csp_log_error("%s: Error allocating context, device: [%s], errno: %s", __FUNCTION__, conf->device, strerror(errno));
+		close(fd);
+		return CSP_ERR_NOMEM;
+	}
+	ctx->rx_callback = rx_callback;
+	ctx->error_callback = conf->error_callback;
+	ctx->user_data = user_data;
+	ctx->fd = fd;
+	ctx->rx_chunk_size = conf->rx_chunk_size ? conf->rx_chunk_size : USART_RX_BUF_SIZE;
+	ctx->rx_gap_us = conf->rx_gap_us;
+
+	if (rx_callback) {
+		/* Keep the configuration for reopening the device */
+		ctx->conf = *conf;
+		ctx->conf.device = strdup(conf->device);
+		ctx->rx_buf = malloc(ctx->rx_chunk_size);
+		if ((ctx->rx_buf == NULL) || (ctx->conf.device == NULL)) {
+			csp_log_error("%s: Error allocating Rx buffer, device: [%s]", __FUNCTION__, conf->device);
+			free((void *) ctx->conf.device);
+			free(ctx->rx_buf);
+			free(ctx);
+			close(fd);
+			return CSP_ERR_NOMEM;
+		}
+		pthread_once(&usart_rx_once, usart_rx_init);
+		struct epoll_event event = {.events = EPOLLIN, .data.ptr = ctx};
+		if ((usart_epoll_fd < 0) || (epoll_ctl(usart_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)) {
+			csp_log_error("%s: failed to add device: [%s] to Rx thread, errno: %s", __FUNCTION__, conf->device, strerror(errno));
+			free((void *) ctx->conf.device);
+			free(ctx->rx_buf);
+			free(ctx);
+			close(fd);
+			return CSP_ERR_DRIVER;
+		}
+	}
+
+	if (return_fd) {
+		*return_fd = fd;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int usart_iface_tx(void * driver_data, const uint8_t * data, size_t len) {
+
+	usart_iface_t * ctx = driver_data;
+	if (csp_usart_write(ctx->fd, data, len) == (int) len) {
+		return CSP_ERR_NONE;
+	}
+	return CSP_ERR_TX;
+}
+
+int usart_iface_txv(void * driver_data, const csp_iovec_t * iov, unsigned int iovcnt) {
+
+	usart_iface_t * ctx = driver_data;
+	if (csp_usart_writev(ctx->fd, iov, iovcnt) >= 0) {
+		return CSP_ERR_NONE;
+	}
+	return CSP_ERR_TX;
+}
+
+static void usart_iface_rx(void * user_data, uint8_t * data, size_t data_size, void * pxTaskWoken) {
+
+	usart_iface_t * ctx = user_data;
+	ctx->rx(&ctx->iface, data, data_size, NULL);
+}
+
+static void usart_iface_error(void * user_data, int error) {
+
+	usart_iface_t * ctx = user_data;
+	ctx->iface.rx_error++;
+
+	/* A partly received frame is lost */
+	if (ctx->rx_reset(&ctx->iface)) {
+		ctx->iface.frame++;
+	}
+}
+
+int usart_iface_open(usart_iface_t * ctx, const csp_usart_conf_t * conf, const char * ifname, void * interface_data,
+                     int (*add_interface)(csp_iface_t * iface), usart_iface_rx_t rx, usart_iface_rx_reset_t rx_reset,
+                     csp_iface_t ** return_iface) {
+
+	csp_log_info("INIT %s: device: [%s], bitrate: %d", ifname, conf->device, conf->baudrate);
+
+	strncpy(ctx->name, ifname, sizeof(ctx->name) - 1);
+	ctx->iface.name = ctx->name;
+	ctx->iface.driver_data = ctx;
+	ctx->iface.interface_data = interface_data;
+	ctx->fd = -1;
+	ctx->rx = rx;
+	ctx->rx_reset = rx_reset;
+
+	int res = add_interface(&ctx->iface);
+	if (res == CSP_ERR_NONE) {
+		csp_usart_conf_t usart_conf = *conf;
+		usart_conf.error_callback = usart_iface_error;
+		res = csp_usart_open(&usart_conf, usart_iface_rx, ctx, &ctx->fd);
+	}
+
+	if (return_iface) {
+		*return_iface = &ctx->iface;
+	}
+
+	return res;
+}
@@ -0,0 +1,42 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "usart_linux_baud.h"
+
+#include <asm/ioctls.h>
+#include <asm/termbits.h>
+
+/* <sys/ioctl.h> conflicts with <asm/termbits.h> */
+extern int ioctl(int fd, unsigned long request, ...);
+
+int usart_set_custom_baudrate(int fd, uint32_t baudrate) {
+
+	struct termios2 options;
+	if (ioctl(fd, TCGETS2, &options) != 0) {
+		return -1;
+	}
+	options.c_cflag &= ~CBAUD;
+	options.c_cflag |= BOTHER;
+	options.c_ispeed = baudrate;
+	options.c_ospeed = baudrate;
+	options.c_cflag &= ~(CBAUD << IBSHIFT);
+	options.c_cflag |= BOTHER << IBSHIFT;
+	return ioctl(fd, TCSETS2, &options);
+}
@@ -0,0 +1,52 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _USART_LINUX_BAUD_H_
+#define _USART_LINUX_BAUD_H_
+
+/**
+   @file
+
+   Custom baud rates (Linux).
+
+   termios2 comes from <asm/termbits.h>, which can't be included together with <termios.h>, hence the separate file.
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Set input and output baud rate on an open tty, with termios2 and BOTHER.
+
+   Other attributes are left unchanged, so this must be called after tcsetattr().
+
+   @param[in] fd file descriptor.
+   @param[in] baudrate bits per second.
+   @return 0 on success, otherwise -1 (errno set).
+*/
+int usart_set_custom_baudrate(int fd, uint32_t baudrate);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
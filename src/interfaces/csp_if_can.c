@@ -0,0 +1,138 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   CAN interface transmit: csp_can_tx(), with CAN FD support.
+
+   csp_can_add_interface() (libcsp.so) installs csp_can_tx() as nexthop through the GOT, so this definition replaces the
+   libcsp.so version. Fragments carry up to csp_can_interface_data_t::frame_size bytes - the CFP format is unchanged, so
+   CAN 2.0 interfaces (frame_size 0 or 8) send exactly the same frames as before. Drivers setting
+   csp_can_interface_data_t::tx_burst_func get the fragments in bursts, e.g. one sendmmsg() per burst.
+*/
+
+#include <csp/interfaces/csp_if_can.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_endian.h>
+#include <csp/csp_rtable.h>
+
+#include "csp_if_can_pbuf.h"
+
+/** Max packet length, limited by the 8 bit remain field (with CAN 2.0 frames) */
+#define CSP_CAN_MTU		2042
+
+/** CSP id and length in the BEGIN fragment */
+#define CFP_OVERHEAD		(sizeof(csp_id_t) + sizeof(uint16_t))
+
+/** Delay in uS between fragments, for slow receivers (nodes 7 and 9) */
+#define CSP_CAN_SLOW_NODE_DELAY_US	100000
+
+static inline bool csp_can_slow_node(uint8_t dest) {
+	return (dest == 7) || (dest == 9);
+}
+
+/**
+   Send frames with the driver's burst function, or one at a time.
+*/
+static int csp_can_tx_frames(csp_iface_t * iface, const csp_can_interface_data_t * ifdata, const csp_can_frame_t * frames, unsigned int count) {
+
+	if (ifdata->tx_burst_func) {
+		return ifdata->tx_burst_func(iface->driver_data, frames, count);
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		const int res = ifdata->tx_func(iface->driver_data, frames[i].id, frames[i].data, frames[i].dlc);
+		if (res != CSP_ERR_NONE) {
+			return res;
+		}
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_can_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	csp_iface_t * iface = ifroute->iface;
+	csp_can_interface_data_t * ifdata = iface->interface_data;
+	const unsigned int frame_size = (ifdata->frame_size > CSP_CAN_FRAME_SIZE) ? ifdata->frame_size : CSP_CAN_FRAME_SIZE;
+
+	/* Get an unique CFP id */
+	const uint32_t ident = ifdata->cfp_frame_id++;
+
+	if (packet->length > CSP_CAN_MTU) {
+		return CSP_ERR_TX;
+	}
+
+	/* Insert destination node/via address into the CFP destination field */
+	const uint8_t dest = (ifroute->via != CSP_NO_VIA_ADDRESS) ? ifroute->via : packet->id.dst;
+
+	const uint32_t base = CFP_MAKE_SRC(packet->id.src) | CFP_MAKE_DST(dest) | CFP_MAKE_ID(ident);
+
+	/* Fragments are collected and passed to the driver in bursts, one at a time for slow nodes */
+	csp_can_frame_t frames[CSP_CAN_TX_BURST];
+	const unsigned int burst = csp_can_slow_node(dest) ? 1 : CSP_CAN_TX_BURST;
+
+	/* First fragment: CSP id, length and the first data bytes */
+	const uint16_t first = ((packet->length + CFP_OVERHEAD) <= frame_size) ? packet->length : (frame_size - CFP_OVERHEAD);
+	frames[0].id = base | CFP_MAKE_TYPE(CFP_BEGIN) |
+	               CFP_MAKE_REMAIN((packet->length - first + frame_size - 1) / frame_size);
+	frames[0].dlc = CFP_OVERHEAD + first;
+	const uint32_t csp_id_be = csp_hton32(packet->id.ext);
+	const uint16_t csp_length_be = csp_hton16(packet->length);
+	memcpy(frames[0].data, &csp_id_be, sizeof(csp_id_be));
+	memcpy(frames[0].data + sizeof(csp_id_be), &csp_length_be, sizeof(csp_length_be));
+	memcpy(frames[0].data + CFP_OVERHEAD, packet->data, first);
+	unsigned int count = 1;
+
+	for (uint16_t tx_count = first; tx_count < packet->length; ) {
+
+		if (count == burst) {
+			if (csp_can_tx_frames(iface, ifdata, frames, count) != CSP_ERR_NONE) {
+				iface->tx_error++;
+				return CSP_ERR_DRIVER;
+			}
+			count = 0;
+		}
+
+		if (csp_can_slow_node(dest)) {
+			usleep(CSP_CAN_SLOW_NODE_DELAY_US);
+		}
+
+		const uint16_t remaining = packet->length - tx_count;
+		const uint16_t bytes = (remaining >= frame_size) ? frame_size : remaining;
+		frames[count].id = base | CFP_MAKE_TYPE(CFP_MORE) | CFP_MAKE_REMAIN((remaining - bytes + frame_size - 1) / frame_size);
+		frames[count].dlc = bytes;
+		memcpy(frames[count].data, packet->data + tx_count, bytes);
+		count++;
+		tx_count += bytes;
+	}
+
+	if (csp_can_tx_frames(iface, ifdata, frames, count) != CSP_ERR_NONE) {
+		iface->tx_error++;
+		return CSP_ERR_DRIVER;
+	}
+
+	csp_buffer_free(packet);
+
+	return CSP_ERR_NONE;
+}
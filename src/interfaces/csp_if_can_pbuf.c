@@ -0,0 +1,414 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   CAN reassembly: csp_can_rx() and packet buffers.
+
+   libcsp.so keeps partial packets in a fixed array of 5 buffers, searched linearly for every fragment. When more senders
+   interleave fragments, new packets are silently dropped until old ones time out. This replaces csp_can_rx() (called by the
+   CAN drivers through the PLT) and the buffers:
+
+   - buffers are found through a hash table on the connection part of the CFP identifier (source, destination, CFP id).
+   - the number of buffers is set at runtime, see csp_can_pbuf_set_size().
+   - when all buffers are in use, the least recently used partial packet is dropped, rather than the new one.
+   - every drop is counted per reason, see csp_can_pbuf_get_stats().
+
+   The buffers are shared by all CAN interfaces, and protected by a mutex (drivers receive in separate threads).
+   csp_can_rx_burst() takes the mutex once for all frames returned by a single driver read.
+*/
+
+#include "csp_if_can_pbuf.h"
+
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_endian.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_time.h>
+
+/** Max packet length, limited by the 8 bit remain field */
+#define CSP_CAN_MTU		2042
+
+/** Max number of packet buffers */
+#define CSP_CAN_PBUF_MAX_SIZE	4096
+
+/** Buffers, hash buckets (power of 2, at least twice the number of buffers) */
+static csp_can_pbuf_element_t * csp_can_pbuf_elements;
+static csp_can_pbuf_element_t ** csp_can_pbuf_buckets;
+static unsigned int csp_can_pbuf_hash_bits;
+
+/** Free buffers, linked through lru_next */
+static csp_can_pbuf_element_t * csp_can_pbuf_free_list;
+
+/** Used buffers, most recently used first */
+static csp_can_pbuf_element_t * csp_can_pbuf_lru_head;
+static csp_can_pbuf_element_t * csp_can_pbuf_lru_tail;
+
+static csp_can_pbuf_stats_t csp_can_pbuf_stats;
+
+static csp_mutex_t csp_can_pbuf_lock;
+
+static inline uint32_t csp_can_pbuf_now(CSP_BASE_TYPE * task_woken) {
+	return (task_woken != NULL) ? csp_get_ms_isr() : csp_get_ms();
+}
+
+static inline csp_can_pbuf_element_t ** csp_can_pbuf_bucket(uint32_t id) {
+	/* Fibonacci hashing of source, destination and CFP id */
+	return &csp_can_pbuf_buckets[((id & CFP_ID_CONN_MASK) * 0x9E3779B1u) >> (32 - csp_can_pbuf_hash_bits)];
+}
+
+static void csp_can_pbuf_lru_unlink(csp_can_pbuf_element_t * buf) {
+
+	if (buf->lru_prev) {
+		buf->lru_prev->lru_next = buf->lru_next;
+	} else {
+		csp_can_pbuf_lru_head = buf->lru_next;
+	}
+	if (buf->lru_next) {
+		buf->lru_next->lru_prev = buf->lru_prev;
+	} else {
+		csp_can_pbuf_lru_tail = buf->lru_prev;
+	}
+	buf->lru_prev = NULL;
+	buf->lru_next = NULL;
+}
+
+static void csp_can_pbuf_lru_push(csp_can_pbuf_element_t * buf) {
+
+	buf->lru_prev = NULL;
+	buf->lru_next = csp_can_pbuf_lru_head;
+	if (csp_can_pbuf_lru_head) {
+		csp_can_pbuf_lru_head->lru_prev = buf;
+	} else {
+		csp_can_pbuf_lru_tail = buf;
+	}
+	csp_can_pbuf_lru_head = buf;
+}
+
+int csp_can_pbuf_free(csp_can_pbuf_element_t * buf, CSP_BASE_TYPE * task_woken) {
+
+	if (buf->packet != NULL) {
+		if (task_woken == NULL) {
+			csp_buffer_free(buf->packet);
+		} else {
+			csp_buffer_free_isr(buf->packet);
+		}
+	}
+
+	if (buf->state == CSP_CAN_PBUF_USED) {
+		for (csp_can_pbuf_element_t ** p = csp_can_pbuf_bucket(buf->cfpid); *p; p = &(*p)->hash_next) {
+			if (*p == buf) {
+				*p = buf->hash_next;
+				break;
+			}
+		}
+		csp_can_pbuf_lru_unlink(buf);
+		csp_can_pbuf_stats.used--;
+
+		buf->lru_next = csp_can_pbuf_free_list;
+		csp_can_pbuf_free_list = buf;
+	}
+
+	buf->rx_count = 0;
+	buf->remain = 0;
+	buf->cfpid = 0;
+	buf->packet = NULL;
+	buf->state = CSP_CAN_PBUF_FREE;
+	buf->last_used = 0;
+	buf->hash_next = NULL;
+
+	return CSP_ERR_NONE;
+}
+
+/**
+   Drop partial packet, and count the reason.
+*/
+static void csp_can_pbuf_drop(csp_can_pbuf_element_t * buf, uint32_t * counter, CSP_BASE_TYPE * task_woken) {
+
+	if (buf->packet != NULL) {
+		(*counter)++;
+	}
+	csp_can_pbuf_free(buf, task_woken);
+}
+
+csp_can_pbuf_element_t * csp_can_pbuf_new(uint32_t id, CSP_BASE_TYPE * task_woken) {
+
+	const uint32_t now = csp_can_pbuf_now(task_woken);
+
+	/* Reclaim timed out buffers, the oldest are at the tail */
+	while (csp_can_pbuf_lru_tail && ((now - csp_can_pbuf_lru_tail->last_used) > CSP_CAN_PBUF_TIMEOUT_MS)) {
+		csp_can_pbuf_drop(csp_can_pbuf_lru_tail, &csp_can_pbuf_stats.timeout, task_woken);
+	}
+
+	/* All in use: drop the least recently used */
+	if ((csp_can_pbuf_free_list == NULL) && csp_can_pbuf_lru_tail) {
+		csp_can_pbuf_drop(csp_can_pbuf_lru_tail, &csp_can_pbuf_stats.evicted, task_woken);
+	}
+
+	csp_can_pbuf_element_t * buf = csp_can_pbuf_free_list;
+	if (buf == NULL) {
+		return NULL;
+	}
+	csp_can_pbuf_free_list = buf->lru_next;
+
+	buf->rx_count = 0;
+	buf->remain = 0;
+	buf->cfpid = id;
+	buf->packet = NULL;
+	buf->state = CSP_CAN_PBUF_USED;
+	buf->last_used = now;
+
+	csp_can_pbuf_element_t ** bucket = csp_can_pbuf_bucket(id);
+	buf->hash_next = *bucket;
+	*bucket = buf;
+	csp_can_pbuf_lru_push(buf);
+	csp_can_pbuf_stats.used++;
+
+	return buf;
+}
+
+csp_can_pbuf_element_t * csp_can_pbuf_find(uint32_t id, uint32_t mask, CSP_BASE_TYPE * task_woken) {
+
+	csp_can_pbuf_element_t * buf;
+	if (mask == CFP_ID_CONN_MASK) {
+		for (buf = *csp_can_pbuf_bucket(id); buf; buf = buf->hash_next) {
+			if (((buf->cfpid ^ id) & mask) == 0) {
+				break;
+			}
+		}
+	} else {
+		for (buf = csp_can_pbuf_lru_head; buf; buf = buf->lru_next) {
+			if (((buf->cfpid ^ id) & mask) == 0) {
+				break;
+			}
+		}
+	}
+	if (buf == NULL) {
+		return NULL;
+	}
+
+	const uint32_t now = csp_can_pbuf_now(task_woken);
+	if ((now - buf->last_used) > CSP_CAN_PBUF_TIMEOUT_MS) {
+		/* Stale - the CFP id has most likely wrapped */
+		csp_can_pbuf_drop(buf, &csp_can_pbuf_stats.timeout, task_woken);
+		return NULL;
+	}
+
+	buf->last_used = now;
+	if (buf != csp_can_pbuf_lru_head) {
+		csp_can_pbuf_lru_unlink(buf);
+		csp_can_pbuf_lru_push(buf);
+	}
+
+	return buf;
+}
+
+/**
+   Allocate \a size buffers, dropping any partial packets.
+*/
+static int csp_can_pbuf_alloc(unsigned int size) {
+
+	unsigned int hash_bits = 1;
+	while ((1U << hash_bits) < (2 * size)) {
+		hash_bits++;
+	}
+
+	csp_can_pbuf_element_t * elements = csp_calloc(size, sizeof(*elements));
+	csp_can_pbuf_element_t ** buckets = csp_calloc(1U << hash_bits, sizeof(*buckets));
+	if ((elements == NULL) || (buckets == NULL)) {
+		csp_free(elements);
+		csp_free(buckets);
+		return CSP_ERR_NOMEM;
+	}
+
+	while (csp_can_pbuf_lru_head) {
+		csp_can_pbuf_free(csp_can_pbuf_lru_head, NULL);
+	}
+	csp_free(csp_can_pbuf_elements);
+	csp_free(csp_can_pbuf_buckets);
+
+	csp_can_pbuf_elements = elements;
+	csp_can_pbuf_buckets = buckets;
+	csp_can_pbuf_hash_bits = hash_bits;
+
+	csp_can_pbuf_free_list = NULL;
+	for (unsigned int i = size; i > 0; i--) {
+		elements[i - 1].lru_next = csp_can_pbuf_free_list;
+		csp_can_pbuf_free_list = &elements[i - 1];
+	}
+	csp_can_pbuf_stats.size = size;
+	csp_can_pbuf_stats.used = 0;
+
+	return CSP_ERR_NONE;
+}
+
+__attribute__((constructor))
+static void csp_can_pbuf_init(void) {
+
+	csp_mutex_create(&csp_can_pbuf_lock);
+	csp_can_pbuf_alloc(CSP_CAN_PBUF_DEFAULT_SIZE);
+}
+
+int csp_can_pbuf_set_size(unsigned int size) {
+
+	if ((size == 0) || (size > CSP_CAN_PBUF_MAX_SIZE)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_mutex_lock(&csp_can_pbuf_lock, CSP_MAX_DELAY);
+	int res = csp_can_pbuf_alloc(size);
+	csp_mutex_unlock(&csp_can_pbuf_lock);
+
+	return res;
+}
+
+void csp_can_pbuf_get_stats(csp_can_pbuf_stats_t * stats) {
+
+	csp_mutex_lock(&csp_can_pbuf_lock, CSP_MAX_DELAY);
+	*stats = csp_can_pbuf_stats;
+	csp_mutex_unlock(&csp_can_pbuf_lock);
+}
+
+/**
+   Process fragment, with the buffer lock held.
+*/
+static int csp_can_rx_locked(csp_iface_t * iface, uint32_t id, const uint8_t * data, uint8_t dlc, CSP_BASE_TYPE * task_woken) {
+
+	csp_can_pbuf_element_t * buf = csp_can_pbuf_find(id, CFP_ID_CONN_MASK, task_woken);
+
+	if (buf == NULL) {
+		if (CFP_TYPE(id) != CFP_BEGIN) {
+			csp_can_pbuf_stats.no_begin++;
+			iface->frame++;
+			return CSP_ERR_INVAL;
+		}
+		buf = csp_can_pbuf_new(id, task_woken);
+		if (buf == NULL) {
+			iface->rx_error++;
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	/* Data offset, the BEGIN fragment starts with CSP id and length */
+	uint8_t offset = 0;
+
+	if (CFP_TYPE(id) == CFP_BEGIN) {
+
+		if (dlc < (sizeof(csp_id_t) + sizeof(uint16_t))) {
+			csp_can_pbuf_stats.malformed++;
+			iface->frame++;
+			csp_can_pbuf_free(buf, task_woken);
+			return CSP_ERR_NONE;
+		}
+
+		if (buf->packet != NULL) {
+			/* Incomplete packet, reuse the CSP buffer */
+			csp_can_pbuf_stats.restarted++;
+			iface->frame++;
+		} else {
+			buf->packet = (task_woken == NULL) ? csp_buffer_get(csp_buffer_data_size()) : csp_buffer_get_isr(csp_buffer_data_size());
+			if (buf->packet == NULL) {
+				csp_can_pbuf_stats.no_buffer++;
+				iface->frame++;
+				csp_can_pbuf_free(buf, task_woken);
+				return CSP_ERR_NONE;
+			}
+		}
+
+		memcpy(&buf->packet->id, data, sizeof(csp_id_t));
+		buf->packet->id.ext = csp_ntoh32(buf->packet->id.ext);
+		memcpy(&buf->packet->length, data + sizeof(csp_id_t), sizeof(uint16_t));
+		buf->packet->length = csp_ntoh16(buf->packet->length);
+
+		if ((buf->packet->length > CSP_CAN_MTU) || (buf->packet->length > csp_buffer_data_size())) {
+			csp_can_pbuf_stats.malformed++;
+			iface->rx_error++;
+			csp_can_pbuf_free(buf, task_woken);
+			return CSP_ERR_NONE;
+		}
+
+		buf->rx_count = 0;
+		offset = sizeof(csp_id_t) + sizeof(uint16_t);
+
+		/* Include the BEGIN fragment */
+		buf->remain = CFP_REMAIN(id) + 1;
+	}
+
+	if (CFP_REMAIN(id) != (buf->remain - 1)) {
+		csp_can_pbuf_stats.sequence++;
+		iface->frame++;
+		csp_can_pbuf_free(buf, task_woken);
+		return CSP_ERR_NONE;
+	}
+	buf->remain--;
+
+	uint16_t bytes = dlc - offset;
+	if ((buf->rx_count + bytes) > buf->packet->length) {
+		if ((buf->remain == 0) && (dlc > CSP_CAN_FRAME_SIZE)) {
+			/* Last CAN FD fragment, padded to a valid CAN FD length */
+			bytes = buf->packet->length - buf->rx_count;
+		} else {
+			csp_can_pbuf_stats.malformed++;
+			iface->frame++;
+			csp_can_pbuf_free(buf, task_woken);
+			return CSP_ERR_NONE;
+		}
+	}
+
+	memcpy(&buf->packet->data[buf->rx_count], data + offset, bytes);
+	buf->rx_count += bytes;
+
+	if (buf->rx_count == buf->packet->length) {
+		csp_can_pbuf_stats.completed++;
+		csp_qfifo_write(buf->packet, iface, task_woken);
+		buf->packet = NULL;
+		csp_can_pbuf_free(buf, task_woken);
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_can_rx(csp_iface_t * iface, uint32_t id, const uint8_t * data, uint8_t dlc, CSP_BASE_TYPE * task_woken) {
+
+	csp_mutex_lock(&csp_can_pbuf_lock, CSP_MAX_DELAY);
+	const int res = csp_can_rx_locked(iface, id, data, dlc, task_woken);
+	csp_mutex_unlock(&csp_can_pbuf_lock);
+
+	return res;
+}
+
+int csp_can_rx_burst(csp_iface_t * iface, const csp_can_frame_t * frames, unsigned int count, CSP_BASE_TYPE * task_woken) {
+
+	int res = CSP_ERR_NONE;
+
+	csp_mutex_lock(&csp_can_pbuf_lock, CSP_MAX_DELAY);
+	for (unsigned int i = 0; i < count; i++) {
+		csp_rx_timestamp_set(&frames[i].timestamp);
+		const int frame_res = csp_can_rx_locked(iface, frames[i].id, frames[i].data, frames[i].dlc, task_woken);
+		if (frame_res != CSP_ERR_NONE) {
+			res = frame_res;
+		}
+	}
+	csp_rx_timestamp_set(NULL);
+	csp_mutex_unlock(&csp_can_pbuf_lock);
+
+	return res;
+}
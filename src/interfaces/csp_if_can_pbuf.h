@@ -0,0 +1,102 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_IF_CAN_PBUF_H_
+#define _CSP_IF_CAN_PBUF_H_
+
+/**
+   @file
+
+   CAN packet buffers (reassembly of CFP fragments).
+
+   Partial packets are kept in a hash table indexed by the connection part of the CFP identifier (#CFP_ID_CONN_MASK), and
+   in a least-recently-used list. The number of buffers is set with csp_can_pbuf_set_size().
+*/
+
+#include <csp/interfaces/csp_if_can.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** CFP type: first fragment */
+#define CFP_BEGIN			0
+
+/** CFP type: subsequent fragments */
+#define CFP_MORE			1
+
+/**
+   Timeout in mS: a partial packet without new fragments for this long is dropped.
+*/
+#define CSP_CAN_PBUF_TIMEOUT_MS		1000
+
+/**
+   Buffer state.
+*/
+typedef enum {
+	CSP_CAN_PBUF_FREE = 0,			//!< Free
+	CSP_CAN_PBUF_USED = 1,			//!< Used, packet being reassembled
+} csp_can_pbuf_state_t;
+
+/**
+   Packet buffer. The first fields have the same layout as in libcsp.so (v1.6).
+*/
+typedef struct csp_can_pbuf_element_s {
+	uint16_t rx_count;			//!< Bytes received
+	uint32_t remain;			//!< Fragments remaining
+	uint32_t cfpid;				//!< CAN identifier of the BEGIN fragment
+	csp_packet_t * packet;			//!< Packet being reassembled, allocated on BEGIN fragment
+	csp_can_pbuf_state_t state;		//!< Buffer state
+	uint32_t last_used;			//!< Time of last fragment (mS)
+	struct csp_can_pbuf_element_s * hash_next;	//!< Next buffer in hash bucket
+	struct csp_can_pbuf_element_s * lru_prev;	//!< More recently used buffer
+	struct csp_can_pbuf_element_s * lru_next;	//!< Less recently used buffer (or next free buffer)
+} csp_can_pbuf_element_t;
+
+/**
+   Free buffer, including the packet being reassembled.
+   @param[in] buf buffer.
+   @param[in] task_woken Valid reference if called from ISR, otherwise NULL.
+   @return #CSP_ERR_NONE
+*/
+int csp_can_pbuf_free(csp_can_pbuf_element_t * buf, CSP_BASE_TYPE * task_woken);
+
+/**
+   Get a new buffer for CAN identifier \a id.
+   Timed out buffers are reclaimed first. If all buffers are in use, the least recently used is dropped.
+   @param[in] id CAN identifier of the BEGIN fragment.
+   @param[in] task_woken Valid reference if called from ISR, otherwise NULL.
+   @return buffer, or NULL if no buffers have been allocated.
+*/
+csp_can_pbuf_element_t * csp_can_pbuf_new(uint32_t id, CSP_BASE_TYPE * task_woken);
+
+/**
+   Find buffer for CAN identifier \a id.
+   @param[in] id CAN identifier.
+   @param[in] mask compare mask, normally #CFP_ID_CONN_MASK (hash lookup). Other masks use a linear search.
+   @param[in] task_woken Valid reference if called from ISR, otherwise NULL.
+   @return buffer, or NULL if not found (or timed out).
+*/
+csp_can_pbuf_element_t * csp_can_pbuf_find(uint32_t id, uint32_t mask, CSP_BASE_TYPE * task_woken);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,394 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   EWC framer: csp_ewc_tx().
+
+   csp_ewc_add_interface() installs csp_ewc_tx() through the GOT, so this definition replaces the Tx function in libcsp.so.
+   The frame is the same - data, CRC16 as 4 hex digits and endSyncWord - but is handed to the driver's txv_func in one
+   call, instead of 3 calls to tx_func.
+
+   EWC deframer: csp_ewc_rx().
+
+   The USART driver calls csp_ewc_rx() through the PLT, so this definition also replaces the Rx function in libcsp.so. Fields
+   are parsed straight into the CSP packet and the CRC16 is updated in runs, so each byte is looked at once. The number of
+   fields is limited by the interface MTU.
+*/
+
+#include <csp/interfaces/csp_if_ewc.h>
+
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_rtable.h>
+
+/**
+   Pass buffers to the driver - in one call if it supports vectored Tx.
+*/
+static void csp_ewc_tx_flush(const csp_ewc_interface_data_t * ifdata, void * driver, const csp_iovec_t * iov, unsigned int iovcnt) {
+
+	if (ifdata->txv_func) {
+		ifdata->txv_func(driver, iov, iovcnt);
+		return;
+	}
+	for (unsigned int i = 0; i < iovcnt; i++) {
+		ifdata->tx_func(driver, iov[i].base, iov[i].len);
+	}
+}
+
+int csp_ewc_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	csp_ewc_interface_data_t * ifdata = ifroute->iface->interface_data;
+	void * driver = ifroute->iface->driver_data;
+
+	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	/* Only the configured node is reachable, packets to other nodes are dropped */
+	if (packet->id.dst == ifdata->nodeNum) {
+		ifdata->sPort = packet->id.sport;
+
+		/* CRC16 as 4 upper case hex digits, same as "%04X" */
+		static const char hex[] = "0123456789ABCDEF";
+		const uint16_t crc = csp_crc16_memory(packet->data, packet->length);
+		const uint8_t crc_hex[4] = {hex[(crc >> 12) & 0xF], hex[(crc >> 8) & 0xF], hex[(crc >> 4) & 0xF], hex[crc & 0xF]};
+
+		const csp_iovec_t iov[] = {
+			{packet->data, packet->length},
+			{crc_hex, sizeof(crc_hex)},
+			{endSyncWord, sizeof(endSyncWord)},
+		};
+		csp_ewc_tx_flush(ifdata, driver, iov, sizeof(iov) / sizeof(iov[0]));
+	}
+
+	csp_buffer_free(packet);
+	csp_mutex_unlock(&ifdata->lock);
+
+	return CSP_ERR_NONE;
+}
+
+/** Bytes at the end of a frame, not included in the CRC: CRC16 as 4 hex digits and endSyncWord */
+#define EWC_RX_CRC_TRAILER	(4 + sizeof(endSyncWord))
+
+/** Length of the Rx header: type char and 2 hex digits length */
+#define EWC_RX_HEADER_LENGTH	3
+
+/** Header type char of a trace frame */
+#define EWC_RX_TRACE		'T'
+
+/** Field separator */
+#define EWC_RX_FIELD_SEPARATOR	':'
+
+/**
+   Return value of hex digit, or -1.
+*/
+static inline int csp_ewc_hex(uint8_t c) {
+
+	if ((c >= '0') && (c <= '9')) {
+		return c - '0';
+	}
+	c |= 0x20; // lower case
+	if ((c >= 'a') && (c <= 'f')) {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+/**
+   Add received frame data to the CRC.
+
+   The last #EWC_RX_CRC_TRAILER bytes are held back in rxTempBuff, as they are only known to be the CRC16 and endSyncWord
+   when the frame ends.
+*/
+static void csp_ewc_rx_crc(csp_ewc_interface_data_t * ifdata, const uint8_t * data, size_t len) {
+
+	const size_t held = ifdata->rxTempBuffCount;
+	if ((held + len) <= EWC_RX_CRC_TRAILER) {
+		memcpy(&ifdata->rxTempBuff[held], data, len);
+		ifdata->rxTempBuffCount = (uint8_t)(held + len);
+		return;
+	}
+
+	size_t feed = held + len - EWC_RX_CRC_TRAILER;
+	const size_t from_held = (feed < held) ? feed : held;
+	ifdata->rx_crc = csp_crc16_update(ifdata->rx_crc, ifdata->rxTempBuff, from_held);
+	memmove(ifdata->rxTempBuff, &ifdata->rxTempBuff[from_held], held - from_held);
+	feed -= from_held;
+
+	ifdata->rx_crc = csp_crc16_update(ifdata->rx_crc, data, feed);
+	memcpy(&ifdata->rxTempBuff[held - from_held], &data[feed], len - feed);
+	ifdata->rxTempBuffCount = EWC_RX_CRC_TRAILER;
+}
+
+/**
+   Start CRC of a new frame.
+*/
+static inline void csp_ewc_rx_crc_reset(csp_ewc_interface_data_t * ifdata) {
+
+	ifdata->rx_crc = 0;
+	ifdata->rxTempBuffCount = 0;
+}
+
+/**
+   Start a new field.
+*/
+static inline void csp_ewc_rx_field_reset(csp_ewc_interface_data_t * ifdata) {
+
+	ifdata->rx_value = 0;
+	ifdata->dataCount = 0;
+}
+
+/**
+   Add char to the current field - same as strtol(field, NULL, 16), the field ends at the first non-hex char.
+*/
+static inline void csp_ewc_rx_field_add(csp_ewc_interface_data_t * ifdata, uint8_t c) {
+
+	if (ifdata->dataCount == EWC_RX_FIELD_END) {
+		return;
+	}
+	const int digit = csp_ewc_hex(c);
+	if (digit < 0) {
+		ifdata->dataCount = EWC_RX_FIELD_END;
+		return;
+	}
+	ifdata->rx_value = (ifdata->rx_value << 4) | (uint32_t) digit;
+	ifdata->dataCount++;
+}
+
+/**
+   Max number of values in a received message, limited by the interface MTU.
+*/
+static unsigned int csp_ewc_rx_max_values(const csp_iface_t * iface) {
+
+	const unsigned int size = iface->mtu ? iface->mtu : csp_buffer_data_size();
+	const unsigned int max_values = (size > 2) ? ((size - 2) / sizeof(uint32_t)) : 0;
+	return (max_values < UINT8_MAX) ? max_values : UINT8_MAX;
+}
+
+/**
+   Route complete frame on.
+
+   The packet data is a #EWC_Message_t: cmdStatus, dataSetCount and the values, which are already in place.
+*/
+static void csp_ewc_rx_deliver(csp_iface_t * iface, csp_ewc_interface_data_t * ifdata, void * pxTaskWoken) {
+
+	csp_packet_t * packet = ifdata->rx_packet;
+	int8_t cmdStatus = 0;
+
+	/* packet->length holds the expected frame length from the header until now */
+	if ((packet->length + 5) == ifdata->rx_length) {
+		if ((uint16_t) ifdata->rx_value != ifdata->rx_crc) {
+			cmdStatus = -102;
+		}
+	}
+	iface->frame++;
+
+	packet->data[0] = (uint8_t) cmdStatus;
+	packet->length = (uint16_t)(2 + (packet->data[1] * sizeof(uint32_t)));
+	packet->id.pri = CSP_PRIO_HIGH;
+	packet->id.src = ifdata->nodeNum;
+	packet->id.dst = ifdata->hostNodeNum;
+	packet->id.dport = ifdata->sPort;
+	packet->id.sport = 8;
+	packet->id.flags = 0;
+
+	csp_qfifo_write(packet, iface, pxTaskWoken);
+	ifdata->rx_packet = NULL;
+}
+
+void csp_ewc_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * pxTaskWoken) {
+
+	csp_ewc_interface_data_t * ifdata = iface->interface_data;
+	const uint8_t * p = buf;
+	const uint8_t * const end = buf + len;
+
+	/* Start of data not yet added to the CRC, NULL if no CRC is running */
+	const uint8_t * crc_from = NULL;
+	switch (ifdata->rx_mode) {
+		case EWC_MODE_NEW_STARTED:
+		case EWC_MODE_HEADER_STARTED:
+		case EWC_MODE_SEPARATOR:
+		case EWC_MODE_STARTED:
+			crc_from = p;
+			break;
+		default:
+			break;
+	}
+
+	while (p < end) {
+
+		if (ifdata->rx_length > ifdata->max_rx_length) {
+			iface->rx_error++;
+			ifdata->rx_mode = EWC_MODE_NOT_STARTED;
+			ifdata->rx_length = 0;
+			ifdata->syncWordCount = 0;
+			crc_from = NULL;
+		}
+
+		switch (ifdata->rx_mode) {
+
+			case EWC_MODE_NOT_STARTED: {
+				const uint8_t * start = memchr(p, '<', (size_t)(end - p));
+				if (start == NULL) {
+					return;
+				}
+				csp_ewc_rx_crc_reset(ifdata);
+				crc_from = start;
+				p = start + 1;
+				ifdata->rx_mode = EWC_MODE_NEW_STARTED;
+				break;
+			}
+
+			case EWC_MODE_NEW_STARTED:
+				if (ifdata->rx_packet == NULL) {
+					ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+					if (ifdata->rx_packet == NULL) {
+						ifdata->rx_mode = EWC_MODE_SKIP_FRAME;
+						crc_from = NULL;
+						p++;
+						break;
+					}
+				}
+				ifdata->rx_packet->data[0] = 0;
+				ifdata->rx_packet->data[1] = 0;
+				ifdata->rx_length = 0;
+				ifdata->syncWordCount = 0;
+				ifdata->rx_mode = EWC_MODE_HEADER_STARTED;
+				/* Header starts with this char */
+				// fallthrough
+
+			case EWC_MODE_HEADER_STARTED: {
+				const uint8_t c = *p++;
+				if (c == '<') {
+					csp_ewc_rx_crc_reset(ifdata);
+					crc_from = p - 1;
+					ifdata->rx_mode = EWC_MODE_NEW_STARTED;
+					break;
+				}
+				ifdata->rxBuff[ifdata->rx_length++] = c;
+				if (ifdata->rx_length < EWC_RX_HEADER_LENGTH) {
+					break;
+				}
+				if (ifdata->rxBuff[0] == EWC_RX_TRACE) {
+					ifdata->rx_mode = EWC_MODE_TRACE_STARTED;
+					crc_from = NULL;
+					break;
+				}
+				const int hi = csp_ewc_hex(ifdata->rxBuff[1]);
+				const int lo = csp_ewc_hex(ifdata->rxBuff[2]);
+				if ((hi < 0) || (lo < 0)) {
+					iface->rx_error++;
+					ifdata->rx_mode = EWC_MODE_NOT_STARTED;
+					ifdata->rx_length = 0;
+					crc_from = NULL;
+					break;
+				}
+				ifdata->rx_packet->length = (uint16_t)(((hi << 4) | lo) + 6);
+				csp_ewc_rx_field_reset(ifdata);
+				ifdata->rx_mode = EWC_MODE_SEPARATOR;
+				break;
+			}
+
+			case EWC_MODE_TRACE_STARTED:
+				/* Skip to endSyncWord */
+				while ((p < end) && (ifdata->rx_length <= ifdata->max_rx_length)) {
+					const uint8_t c = *p++;
+					ifdata->rx_length++;
+					if (c == '<') {
+						csp_ewc_rx_crc_reset(ifdata);
+						crc_from = p - 1;
+						ifdata->rx_mode = EWC_MODE_NEW_STARTED;
+						break;
+					}
+					if (c == endSyncWord[ifdata->syncWordCount]) {
+						if (++ifdata->syncWordCount == sizeof(endSyncWord)) {
+							ifdata->syncWordCount = 0;
+							csp_ewc_rx_crc_reset(ifdata);
+							crc_from = p;
+							ifdata->rx_mode = EWC_MODE_NEW_STARTED;
+							break;
+						}
+					}
+				}
+				break;
+
+			case EWC_MODE_SEPARATOR:
+				p++;
+				ifdata->rx_mode = EWC_MODE_STARTED;
+				break;
+
+			case EWC_MODE_STARTED: {
+				csp_packet_t * packet = ifdata->rx_packet;
+				const unsigned int max_values = csp_ewc_rx_max_values(iface);
+				while ((p < end) && (ifdata->rx_length <= ifdata->max_rx_length)) {
+					const uint8_t c = *p++;
+					ifdata->rx_length++;
+					if (c == '<') {
+						csp_ewc_rx_crc_reset(ifdata);
+						crc_from = p - 1;
+						ifdata->rx_mode = EWC_MODE_NEW_STARTED;
+						break;
+					}
+					if (c == endSyncWord[ifdata->syncWordCount]) {
+						if (++ifdata->syncWordCount == sizeof(endSyncWord)) {
+							ifdata->syncWordCount = 0;
+							csp_ewc_rx_crc(ifdata, crc_from, (size_t)(p - crc_from));
+							crc_from = NULL;
+							csp_ewc_rx_deliver(iface, ifdata, pxTaskWoken);
+							ifdata->rx_mode = EWC_MODE_NOT_STARTED;
+							ifdata->rx_length = 0;
+							break;
+						}
+						continue;
+					}
+					ifdata->syncWordCount = 0;
+					if (c == EWC_RX_FIELD_SEPARATOR) {
+						const uint8_t count = packet->data[1];
+						if (count >= max_values) {
+							/* Message does not fit in the MTU */
+							iface->rx_error++;
+							ifdata->rx_mode = EWC_MODE_NOT_STARTED;
+							ifdata->rx_length = 0;
+							crc_from = NULL;
+							break;
+						}
+						memcpy(&packet->data[2 + (count * sizeof(uint32_t))], &ifdata->rx_value, sizeof(uint32_t));
+						packet->data[1] = (uint8_t)(count + 1);
+						csp_ewc_rx_field_reset(ifdata);
+					} else {
+						csp_ewc_rx_field_add(ifdata, c);
+					}
+				}
+				break;
+			}
+
+			case EWC_MODE_SKIP_FRAME:
+			default:
+				p++;
+				ifdata->rx_mode = EWC_MODE_NOT_STARTED;
+				break;
+		}
+	}
+
+	if (crc_from) {
+		csp_ewc_rx_crc(ifdata, crc_from, (size_t)(end - crc_from));
+	}
+}
@@ -0,0 +1,351 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   KISS framer/deframer: csp_kiss_tx() and csp_kiss_rx().
+
+   The drivers call csp_kiss_rx() through the PLT, so this definition replaces the bytewise state machine in libcsp.so.
+   The frame format and states are the same, but data is handled in runs:
+
+   - inside a frame, the data up to the next FEND/FESC is found with SIMD compares (AVX2 32 bytes, SSE2/NEON 16 bytes - NEON
+     only if built with CSP_ARM_ACCEL) and copied with memcpy().
+   - outside a frame, memchr() skips to the next FEND.
+   - only FEND/FESC, escaped characters and the first byte after a FEND (TNC_DATA) go through the state machine.
+
+   csp_kiss_add_interface() installs csp_kiss_tx() through the GOT, so this definition also replaces the Tx function, which
+   called the driver once per byte. The frame is described as a list of buffers instead - the unescaped runs point into the
+   packet, escape sequences to constant 2 byte strings - and handed to the driver's txv_func in one call.
+*/
+
+#include <csp/interfaces/csp_if_kiss.h>
+
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_crc32.h>
+#include <csp/csp_endian.h>
+#include <csp/csp_rtable.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+#include <arm_neon.h>
+#endif
+
+#define FEND		0xC0
+#define FESC		0xDB
+#define TFEND		0xDC
+#define TFESC		0xDD
+#define TNC_DATA	0x00
+
+/** Max number of buffers per call to the driver, a frame needing more is sent in several calls */
+#define KISS_TX_IOV_MAX	64
+
+/**
+   Find the first FEND or FESC in [buf, end).
+   @return pointer to FEND/FESC, or \a end if there is none.
+*/
+typedef const uint8_t * (*csp_kiss_scan_t)(const uint8_t * buf, const uint8_t * end);
+
+static const uint8_t * csp_kiss_scan_sw(const uint8_t * buf, const uint8_t * end) {
+
+	while ((buf < end) && (*buf != FEND) && (*buf != FESC)) {
+		buf++;
+	}
+	return buf;
+}
+
+#if defined(__x86_64__)
+
+static const uint8_t * csp_kiss_scan_sse2(const uint8_t * buf, const uint8_t * end) {
+
+	const __m128i fend = _mm_set1_epi8((char) FEND);
+	const __m128i fesc = _mm_set1_epi8((char) FESC);
+	for (; (end - buf) >= 16; buf += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *) buf);
+		const unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, fend), _mm_cmpeq_epi8(v, fesc)));
+		if (mask) {
+			return buf + __builtin_ctz(mask);
+		}
+	}
+	return csp_kiss_scan_sw(buf, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t * csp_kiss_scan_avx2(const uint8_t * buf, const uint8_t * end) {
+
+	const __m256i fend = _mm256_set1_epi8((char) FEND);
+	const __m256i fesc = _mm256_set1_epi8((char) FESC);
+	for (; (end - buf) >= 32; buf += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i *) buf);
+		const unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, fend), _mm256_cmpeq_epi8(v, fesc)));
+		if (mask) {
+			return buf + __builtin_ctz(mask);
+		}
+	}
+	return csp_kiss_scan_sse2(buf, end);
+}
+
+#endif // __x86_64__
+
+#if defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+
+static const uint8_t * csp_kiss_scan_neon(const uint8_t * buf, const uint8_t * end) {
+
+	const uint8x16_t fend = vdupq_n_u8(FEND);
+	const uint8x16_t fesc = vdupq_n_u8(FESC);
+	for (; (end - buf) >= 16; buf += 16) {
+		const uint8x16_t v = vld1q_u8(buf);
+		const uint8x16_t eq = vorrq_u8(vceqq_u8(v, fend), vceqq_u8(v, fesc));
+		/* Narrow to 4 bits per byte */
+		const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		if (mask) {
+			return buf + (__builtin_ctzll(mask) >> 2);
+		}
+	}
+	return csp_kiss_scan_sw(buf, end);
+}
+
+#endif // __aarch64__
+
+/** Selected implementation, set by csp_kiss_rx_setup() */
+static csp_kiss_scan_t csp_kiss_scan = csp_kiss_scan_sw;
+
+__attribute__((constructor))
+static void csp_kiss_rx_setup(void) {
+
+#if defined(__x86_64__)
+	csp_kiss_scan = csp_kiss_scan_sse2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		csp_kiss_scan = csp_kiss_scan_avx2;
+	}
+#elif defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+	csp_kiss_scan = csp_kiss_scan_neon;
+#endif
+}
+
+void csp_kiss_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * pxTaskWoken) {
+
+	csp_kiss_interface_data_t * ifdata = iface->interface_data;
+	const uint8_t * const end = buf + len;
+
+	while (buf < end) {
+
+		/* If packet was too long */
+		if (ifdata->rx_length > ifdata->max_rx_length) {
+			iface->rx_error++;
+			ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+			ifdata->rx_length = 0;
+		}
+
+		if ((ifdata->rx_mode == KISS_MODE_STARTED) && !ifdata->rx_first) {
+			/* Copy data up to the next FEND/FESC, at most until the packet is too long */
+			size_t run = csp_kiss_scan(buf, end) - buf;
+			const size_t space = ifdata->max_rx_length + 1 - ifdata->rx_length;
+			if (run > space) {
+				run = space;
+			}
+			if (run) {
+				memcpy(((uint8_t *) &ifdata->rx_packet->id.ext) + ifdata->rx_length, buf, run);
+				ifdata->rx_length += run;
+				buf += run;
+				continue;
+			}
+		} else if ((ifdata->rx_mode == KISS_MODE_NOT_STARTED) || (ifdata->rx_mode == KISS_MODE_SKIP_FRAME)) {
+			/* Skip any characters until End char detected */
+			const uint8_t * fend = memchr(buf, FEND, end - buf);
+			if (fend == NULL) {
+				break;
+			}
+			buf = fend;
+		}
+
+		const uint8_t inputbyte = *buf++;
+
+		switch (ifdata->rx_mode) {
+			case KISS_MODE_NOT_STARTED:
+				/* Try to allocate new buffer */
+				if (ifdata->rx_packet == NULL) {
+					ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+				}
+
+				/* If no more memory, skip frame */
+				if (ifdata->rx_packet == NULL) {
+					ifdata->rx_mode = KISS_MODE_SKIP_FRAME;
+					break;
+				}
+
+				/* Start transfer */
+				ifdata->rx_length = 0;
+				ifdata->rx_mode = KISS_MODE_STARTED;
+				ifdata->rx_first = true;
+				break;
+
+			case KISS_MODE_STARTED:
+				/* Escape char */
+				if (inputbyte == FESC) {
+					ifdata->rx_mode = KISS_MODE_ESCAPED;
+					break;
+				}
+
+				/* End Char */
+				if (inputbyte == FEND) {
+
+					/* Accept message */
+					if (ifdata->rx_length > 0) {
+
+						/* Check for valid length */
+						if (ifdata->rx_length < CSP_HEADER_LENGTH + sizeof(uint32_t)) {
+							iface->rx_error++;
+							ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+							break;
+						}
+
+						/* Count received frame */
+						iface->frame++;
+
+						/* The CSP packet length is without the header */
+						ifdata->rx_packet->length = ifdata->rx_length - CSP_HEADER_LENGTH;
+
+						/* Convert the packet from network to host order */
+						ifdata->rx_packet->id.ext = csp_ntoh32(ifdata->rx_packet->id.ext);
+
+						/* Validate CRC */
+						if (csp_crc32_verify(ifdata->rx_packet, false) != CSP_ERR_NONE) {
+							iface->rx_error++;
+							ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+							break;
+						}
+
+						/* Send back into CSP, notice calling from task so last argument must be NULL! */
+						csp_qfifo_write(ifdata->rx_packet, iface, pxTaskWoken);
+						ifdata->rx_packet = NULL;
+						ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+						break;
+					}
+
+					/* Break after the end char */
+					break;
+				}
+
+				/* Skip the first char after FEND which is TNC_DATA (0x00) */
+				if (ifdata->rx_first) {
+					ifdata->rx_first = false;
+					break;
+				}
+
+				/* Valid data char */
+				((uint8_t *) &ifdata->rx_packet->id.ext)[ifdata->rx_length++] = inputbyte;
+				break;
+
+			case KISS_MODE_ESCAPED:
+				/* Escaped escape char */
+				if (inputbyte == TFESC) {
+					((uint8_t *) &ifdata->rx_packet->id.ext)[ifdata->rx_length++] = FESC;
+				}
+
+				/* Escaped fend char */
+				if (inputbyte == TFEND) {
+					((uint8_t *) &ifdata->rx_packet->id.ext)[ifdata->rx_length++] = FEND;
+				}
+
+				/* Go back to started mode */
+				ifdata->rx_mode = KISS_MODE_STARTED;
+				break;
+
+			case KISS_MODE_SKIP_FRAME:
+				/* Just wait for end char */
+				ifdata->rx_mode = KISS_MODE_NOT_STARTED;
+				break;
+		}
+	}
+}
+
+static const uint8_t kiss_tx_start[] = {FEND, TNC_DATA};
+static const uint8_t kiss_tx_esc_end[] = {FESC, TFEND};
+static const uint8_t kiss_tx_esc_esc[] = {FESC, TFESC};
+static const uint8_t kiss_tx_stop[] = {FEND};
+
+/**
+   Pass buffers to the driver - in one call if it supports vectored Tx.
+*/
+static void csp_kiss_tx_flush(const csp_kiss_interface_data_t * ifdata, void * driver, const csp_iovec_t * iov, unsigned int iovcnt) {
+
+	if (ifdata->txv_func) {
+		ifdata->txv_func(driver, iov, iovcnt);
+		return;
+	}
+	for (unsigned int i = 0; i < iovcnt; i++) {
+		ifdata->tx_func(driver, iov[i].base, iov[i].len);
+	}
+}
+
+int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	csp_kiss_interface_data_t * ifdata = ifroute->iface->interface_data;
+	void * driver = ifroute->iface->driver_data;
+
+	/* Add CRC32 checksum */
+	csp_crc32_append(packet, false);
+
+	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	/* Save the outgoing id in the buffer */
+	packet->id.ext = csp_hton32(packet->id.ext);
+	packet->length += sizeof(packet->id.ext);
+
+	csp_iovec_t iov[KISS_TX_IOV_MAX];
+	unsigned int iovcnt = 0;
+	iov[iovcnt++] = (csp_iovec_t) {kiss_tx_start, sizeof(kiss_tx_start)};
+
+	const uint8_t * data = (const uint8_t *) &packet->id.ext;
+	const uint8_t * const end = data + packet->length;
+	while (data < end) {
+		/* Room for a run, an escape sequence and the stop char */
+		if ((iovcnt + 3) > KISS_TX_IOV_MAX) {
+			csp_kiss_tx_flush(ifdata, driver, iov, iovcnt);
+			iovcnt = 0;
+		}
+
+		const uint8_t * special = csp_kiss_scan(data, end);
+		if (special > data) {
+			iov[iovcnt++] = (csp_iovec_t) {data, special - data};
+		}
+		if (special < end) {
+			iov[iovcnt++] = (*special == FEND) ? (csp_iovec_t) {kiss_tx_esc_end, sizeof(kiss_tx_esc_end)} :
+			                                     (csp_iovec_t) {kiss_tx_esc_esc, sizeof(kiss_tx_esc_esc)};
+			special++;
+		}
+		data = special;
+	}
+
+	iov[iovcnt++] = (csp_iovec_t) {kiss_tx_stop, sizeof(kiss_tx_stop)};
+	csp_kiss_tx_flush(ifdata, driver, iov, iovcnt);
+
+	csp_buffer_free(packet);
+	csp_mutex_unlock(&ifdata->lock);
+
+	return CSP_ERR_NONE;
+}
@@ -0,0 +1,300 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   MS200 framer: csp_ms200_tx().
+
+   csp_ms200_add_interface() installs csp_ms200_tx() through the GOT, so this definition replaces the Tx function in
+   libcsp.so. The frame is the same - #MS200_Header_t followed by the data - but the header is built on the stack and
+   handed to the driver's txv_func together with the data in one call, instead of 6 calls to tx_func.
+
+   MS200 deframer: csp_ms200_rx().
+
+   The USART driver calls csp_ms200_rx() through the PLT, so this definition also replaces the bytewise state machine in
+   libcsp.so. Data is handled in runs:
+
+   - outside a frame, the sync word is found with SIMD compares (SSE2/NEON 16 bytes, NEON only if built with CSP_ARM_ACCEL)
+     of its first 2 bytes, and candidates are verified with memcmp().
+   - the header is validated in place, and only staged in rxData if it is split between chunks.
+   - the payload is copied with memcpy() straight into the CSP packet, so the frame size is only limited by the CSP buffer size.
+*/
+
+#include <csp/interfaces/csp_if_ms200.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#include <csp/csp_buffer.h>
+#include <csp/csp_debug.h>
+#include <csp/csp_endian.h>
+#include <csp/csp_rtable.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+#include <arm_neon.h>
+#endif
+
+/** Length of the header following the sync word: streamId, sequence, length and secondaryHeader */
+#define MS200_RX_HEADER_LENGTH	(sizeof(MS200_Header_t) - sizeof(ms200SyncWord))
+
+/** Offset of the length field in the header following the sync word */
+#define MS200_RX_LENGTH_OFFSET	(offsetof(MS200_Header_t, length) - sizeof(ms200SyncWord))
+
+/**
+   Pass buffers to the driver - in one call if it supports vectored Tx.
+*/
+static void csp_ms200_tx_flush(const csp_ms200_interface_data_t * ifdata, void * driver, const csp_iovec_t * iov, unsigned int iovcnt) {
+
+	if (ifdata->txv_func) {
+		ifdata->txv_func(driver, iov, iovcnt);
+		return;
+	}
+	for (unsigned int i = 0; i < iovcnt; i++) {
+		ifdata->tx_func(driver, iov[i].base, iov[i].len);
+	}
+}
+
+int csp_ms200_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	csp_ms200_interface_data_t * ifdata = ifroute->iface->interface_data;
+	void * driver = ifroute->iface->driver_data;
+
+	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	/* Only the configured node is reachable, packets to other nodes are dropped */
+	if (packet->id.dst == ifdata->nodeNum) {
+		MS200_MessageHeader_t header;
+		memcpy(header.hdr.syncWord, ms200SyncWord, sizeof(header.hdr.syncWord));
+		memcpy(header.hdr.streamId, ms200AppId, sizeof(header.hdr.streamId));
+		memcpy(header.hdr.sequence, ms200Sequence, sizeof(header.hdr.sequence));
+		const uint16_t length = csp_hton16(packet->length + 8);
+		memcpy(header.hdr.length, &length, sizeof(header.hdr.length));
+		memcpy(header.hdr.secondaryHeader, ms200SecondaryHeader, sizeof(header.hdr.secondaryHeader));
+
+		const csp_iovec_t iov[] = {
+			{header.toByte, sizeof(header.toByte)},
+			{packet->data, packet->length},
+		};
+		csp_ms200_tx_flush(ifdata, driver, iov, sizeof(iov) / sizeof(iov[0]));
+	}
+
+	csp_buffer_free(packet);
+	csp_mutex_unlock(&ifdata->lock);
+
+	return CSP_ERR_NONE;
+}
+
+/**
+   Find the first sync word candidate in [buf, end - 3), by its first 2 bytes.
+   @return pointer to candidate, or NULL if there is none.
+*/
+static const uint8_t * csp_ms200_scan(const uint8_t * buf, const uint8_t * end) {
+
+#if defined(__x86_64__)
+	const __m128i s0 = _mm_set1_epi8((char) ms200SyncWord[0]);
+	const __m128i s1 = _mm_set1_epi8((char) ms200SyncWord[1]);
+	for (; (end - buf) >= (16 + 3); buf += 16) {
+		const __m128i v0 = _mm_loadu_si128((const __m128i *) buf);
+		const __m128i v1 = _mm_loadu_si128((const __m128i *) (buf + 1));
+		const unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, s0), _mm_cmpeq_epi8(v1, s1)));
+		if (mask) {
+			return buf + __builtin_ctz(mask);
+		}
+	}
+#elif defined(__aarch64__) && defined(CSP_ARM_ACCEL)
+	const uint8x16_t s0 = vdupq_n_u8(ms200SyncWord[0]);
+	const uint8x16_t s1 = vdupq_n_u8(ms200SyncWord[1]);
+	for (; (end - buf) >= (16 + 3); buf += 16) {
+		const uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(buf), s0), vceqq_u8(vld1q_u8(buf + 1), s1));
+		/* Narrow to 4 bits per byte */
+		const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		if (mask) {
+			return buf + (__builtin_ctzll(mask) >> 2);
+		}
+	}
+#endif
+
+	for (; (end - buf) > 3; buf++) {
+		if ((buf[0] == ms200SyncWord[0]) && (buf[1] == ms200SyncWord[1])) {
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+/**
+   Find the sync word in [buf, end).
+
+   A sync word split between chunks is tracked in syncWordCount. The sync word does not overlap with itself, so after a
+   mismatch the search simply continues.
+
+   @return pointer to first byte following the sync word, or NULL if it was not found.
+*/
+static const uint8_t * csp_ms200_rx_sync(csp_ms200_interface_data_t * ifdata, const uint8_t * buf, const uint8_t * end) {
+
+	/* Continue a sync word from the previous chunk */
+	while (ifdata->syncWordCount && (buf < end)) {
+		if (*buf != ms200SyncWord[ifdata->syncWordCount]) {
+			ifdata->syncWordCount = 0;
+			break;
+		}
+		buf++;
+		if (++ifdata->syncWordCount == sizeof(ms200SyncWord)) {
+			ifdata->syncWordCount = 0;
+			return buf;
+		}
+	}
+	if (ifdata->syncWordCount) {
+		return NULL;
+	}
+
+	for (const uint8_t * candidate; (candidate = csp_ms200_scan(buf, end)) != NULL; buf = candidate + 1) {
+		if (memcmp(candidate, ms200SyncWord, sizeof(ms200SyncWord)) == 0) {
+			return candidate + sizeof(ms200SyncWord);
+		}
+	}
+
+	/* Keep a partial sync word at the end for the next chunk */
+	const size_t tail = ((end - buf) < (ptrdiff_t) sizeof(ms200SyncWord)) ? (size_t)(end - buf) : (sizeof(ms200SyncWord) - 1);
+	for (size_t count = tail; count > 0; count--) {
+		if (memcmp(end - count, ms200SyncWord, count) == 0) {
+			ifdata->syncWordCount = (uint8_t) count;
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+   Route complete frame on.
+*/
+static void csp_ms200_rx_deliver(csp_iface_t * iface, csp_ms200_interface_data_t * ifdata, void * pxTaskWoken) {
+
+	csp_packet_t * packet = ifdata->rx_packet;
+
+	packet->length = (uint16_t)(ifdata->dataLength - MS200_RX_HEADER_LENGTH);
+	packet->id.pri = CSP_PRIO_HIGH;
+	packet->id.src = ifdata->nodeNum;
+	packet->id.dst = ifdata->hostNodeNum;
+	packet->id.dport = 22;
+	packet->id.sport = 22;
+	packet->id.flags = 0;
+
+	iface->frame++;
+	iface->rxbytes += sizeof(ms200SyncWord) + ifdata->dataLength;
+
+	csp_qfifo_write(packet, iface, pxTaskWoken);
+	ifdata->rx_packet = NULL;
+}
+
+void csp_ms200_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * pxTaskWoken) {
+
+	csp_ms200_interface_data_t * ifdata = iface->interface_data;
+	const uint8_t * const end = buf + len;
+
+	while (buf < end) {
+
+		switch (ifdata->rx_mode) {
+
+			case MS200_MODE_HEADER_STARTED: {
+				const uint8_t * header;
+				if ((ifdata->rx_length == 0) && ((size_t)(end - buf) >= MS200_RX_HEADER_LENGTH)) {
+					/* Complete header in this chunk */
+					header = buf;
+					buf += MS200_RX_HEADER_LENGTH;
+				} else {
+					size_t count = MS200_RX_HEADER_LENGTH - ifdata->rx_length;
+					if (count > (size_t)(end - buf)) {
+						count = end - buf;
+					}
+					memcpy(&ifdata->rxData[ifdata->rx_length], buf, count);
+					ifdata->rx_length += count;
+					buf += count;
+					if (ifdata->rx_length < MS200_RX_HEADER_LENGTH) {
+						break;
+					}
+					header = ifdata->rxData;
+				}
+
+				/* The length field is the frame length (from streamId) - 7 */
+				const unsigned int length = (header[MS200_RX_LENGTH_OFFSET] << 8) | header[MS200_RX_LENGTH_OFFSET + 1];
+				if (((length + 7) < MS200_RX_HEADER_LENGTH) || ((length + 7 - MS200_RX_HEADER_LENGTH) > csp_buffer_data_size())) {
+					csp_log_warn("MS200 RX invalid length: %u", length);
+					iface->rx_error++;
+					ifdata->rx_mode = MS200_MODE_NOT_STARTED;
+					ifdata->rx_length = 0;
+					break;
+				}
+				ifdata->dataLength = (uint16_t)(length + 7);
+				ifdata->rx_length = MS200_RX_HEADER_LENGTH;
+
+				if (ifdata->rx_packet == NULL) {
+					ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+				}
+				ifdata->rx_mode = (ifdata->rx_packet != NULL) ? MS200_MODE_STARTED : MS200_MODE_SKIP_FRAME;
+				if ((ifdata->rx_mode == MS200_MODE_STARTED) && (ifdata->rx_length == ifdata->dataLength)) {
+					/* No payload */
+					csp_ms200_rx_deliver(iface, ifdata, pxTaskWoken);
+					ifdata->rx_mode = MS200_MODE_NOT_STARTED;
+					ifdata->rx_length = 0;
+				}
+				break;
+			}
+
+			case MS200_MODE_STARTED:
+			case MS200_MODE_SKIP_FRAME: {
+				size_t count = ifdata->dataLength - ifdata->rx_length;
+				if (count > (size_t)(end - buf)) {
+					count = end - buf;
+				}
+				if (ifdata->rx_mode == MS200_MODE_STARTED) {
+					memcpy(&ifdata->rx_packet->data[ifdata->rx_length - MS200_RX_HEADER_LENGTH], buf, count);
+				}
+				ifdata->rx_length += count;
+				buf += count;
+				if (ifdata->rx_length < ifdata->dataLength) {
+					break;
+				}
+				if (ifdata->rx_mode == MS200_MODE_STARTED) {
+					csp_ms200_rx_deliver(iface, ifdata, pxTaskWoken);
+				}
+				ifdata->rx_mode = MS200_MODE_NOT_STARTED;
+				ifdata->rx_length = 0;
+				break;
+			}
+
+			case MS200_MODE_NOT_STARTED:
+			case MS200_MODE_NEW_STARTED:
+			default:
+				buf = csp_ms200_rx_sync(ifdata, buf, end);
+				if (buf == NULL) {
+					return;
+				}
+				ifdata->rx_mode = MS200_MODE_HEADER_STARTED;
+				ifdata->rx_length = 0;
+				break;
+		}
+	}
+}
@@ -0,0 +1,610 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+   ZMQ interface: csp_zmqhub_tx() and csp_zmqhub_task().
+
+   Defined here (with the init functions, so the driver data is private to this file), replacing the ZMQ interface in
+   libcsp.so. The frame is the same - the via/destination address, followed by the CSP id and data - but the CSP buffer
+   is used as ZMQ message data in both directions:
+
+   - Tx: the packet is handed to ZMQ with zmq_msg_init_data(), and freed by ZMQ when it has been sent. ZMQ may queue
+     messages (up to ZMQ_SNDHWM, default 1000) if the proxy or link is slow, so at most 1/#CSP_ZMQ_TX_BUFFER_SHARE of the
+     CSP buffers are held this way - further packets are copied into a ZMQ message and freed right away. Otherwise ZMQ
+     could hold the whole buffer pool, and Rx on all interfaces would fail in csp_buffer_get().
+   - Rx: the message is received with zmq_recv() directly into a CSP buffer, instead of into a zmq_msg_t (allocated
+     per message) and then copied.
+
+   Rx filters are ZMQ subscriptions on the first byte of the frame. The subscriptions are forwarded by the zmqproxy
+   (XPUB/XSUB), so messages not matching any filter are dropped before they are sent to this client.
+
+   In-process (inproc://) endpoints use a ZMQ context shared by all interfaces in the process and the zmqproxy started by
+   csp_zmqhub_proxy_start(), as inproc endpoints are only visible within a context.
+
+   Rx can be spread over several subscribe sockets, each with its own thread (csp_zmqhub_task()). A thread drains its socket
+   in bursts (ZMQ_DONTWAIT after the first message), before passing the packets on to the router.
+*/
+
+#include <csp/interfaces/csp_if_zmqhub.h>
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zmq.h>
+
+#include <csp/csp.h>
+#include <csp/csp_debug.h>
+#include <csp/csp_rtable.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_thread.h>
+#include <csp/arch/csp_semaphore.h>
+
+/** Default MTU of the ZMQ interface */
+#define CSP_ZMQ_MTU   1400
+
+/** Size of the ZMQ frame header: via/destination address and CSP id */
+#define CSP_ZMQ_HEADER_SIZE   (sizeof(uint8_t) + sizeof(((csp_packet_t *)0)->id))
+
+/** Number of possible subscriptions (address/via), divided between the subscribe sockets if there are no Rx filters */
+#define CSP_ZMQ_ADDRESSES   256
+
+/** Max share (1/n) of the CSP buffers held by ZMQ for zero-copy Tx */
+#define CSP_ZMQ_TX_BUFFER_SHARE   4
+
+/** Transport prefix of in-process endpoints */
+#define CSP_ZMQ_INPROC   "inproc://"
+
+typedef struct zmq_driver zmq_driver_t;
+
+/**
+   Subscribe socket and its Rx thread.
+*/
+typedef struct {
+	zmq_driver_t * drv;
+	void * subscriber;
+	csp_thread_handle_t rx_thread;
+} zmq_rx_socket_t;
+
+/**
+   ZMQ driver & interface.
+*/
+struct zmq_driver {
+	void * context;
+	void * publisher;
+	csp_bin_sem_handle_t tx_wait;
+	//! Rx threads wait for rx_start until all are created, and only run if rx_run is set - else they post rx_stopped and exit.
+	csp_bin_sem_handle_t rx_start;
+	csp_bin_sem_handle_t rx_stopped;
+	bool rx_run;
+	//! Packets held by ZMQ (zero-copy Tx), and max allowed.
+	unsigned int tx_held;
+	unsigned int tx_held_max;
+	unsigned int rx_burst;
+	unsigned int rx_socket_count;
+	zmq_rx_socket_t * rx_sockets;
+	char name[CSP_IFLIST_NAME_MAX + 1];
+	csp_iface_t iface;
+};
+
+/**
+   Start of the ZMQ frame in a CSP packet: the address byte just before the CSP id.
+*/
+static inline uint8_t * csp_zmqhub_frame(csp_packet_t * packet) {
+	return ((uint8_t *) &packet->id) - sizeof(uint8_t);
+}
+
+/**
+   Free packet, when ZMQ is done with the message data (called from a ZMQ I/O thread).
+*/
+static void csp_zmqhub_free_packet(void * data, void * hint) {
+
+	zmq_driver_t * drv = hint;
+
+	csp_buffer_free((uint8_t *) data + sizeof(uint8_t) - offsetof(csp_packet_t, id));
+	__atomic_fetch_sub(&drv->tx_held, 1, __ATOMIC_RELAXED);
+}
+
+int csp_zmqhub_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	zmq_driver_t * drv = ifroute->iface->driver_data;
+
+	const uint8_t dest = (ifroute->via != CSP_NO_VIA_ADDRESS) ? ifroute->via : packet->id.dst;
+	const size_t size = packet->length + CSP_ZMQ_HEADER_SIZE;
+
+	/* The address byte overwrites the upper byte of packet->length - the packet is not used by CSP after this */
+	uint8_t * frame = csp_zmqhub_frame(packet);
+	*frame = dest;
+
+	zmq_msg_t msg;
+	if (__atomic_fetch_add(&drv->tx_held, 1, __ATOMIC_RELAXED) < drv->tx_held_max) {
+		zmq_msg_init_data(&msg, frame, size, csp_zmqhub_free_packet, drv);
+	} else {
+		/* ZMQ holds its share of the CSP buffers already, copy */
+		__atomic_fetch_sub(&drv->tx_held, 1, __ATOMIC_RELAXED);
+		const int res = zmq_msg_init_size(&msg, size);
+		if (res == 0) {
+			memcpy(zmq_msg_data(&msg), frame, size);
+		}
+		csp_buffer_free(packet);
+		if (res != 0) {
+			csp_log_error("ZMQ send error: %u %s\r\n", res, zmq_strerror(zmq_errno()));
+			return CSP_ERR_NONE;
+		}
+	}
+
+	csp_bin_sem_wait(&drv->tx_wait, 1000); /* Using ZMQ in thread safe manner*/
+	int result = zmq_msg_send(&msg, drv->publisher, 0);
+	csp_bin_sem_post(&drv->tx_wait); /* Release tx semaphore */
+	if (result < 0) {
+		csp_log_error("ZMQ send error: %u %s\r\n", result, zmq_strerror(zmq_errno()));
+		/* Message was not sent, closing it frees the packet (zero-copy) */
+		zmq_msg_close(&msg);
+	}
+
+	return CSP_ERR_NONE;
+}
+
+/**
+   Receive a message into \a packet.
+   @return 1 if a valid message was received, 0 if an invalid message was received, -1 on error (EAGAIN if there are no more messages).
+*/
+static int csp_zmqhub_recv(zmq_driver_t * drv, void * subscriber, csp_packet_t * packet, int flags) {
+
+	/* Frame is received at the address byte before the CSP id, and may fill the entire CSP buffer */
+	const size_t max_size = CSP_ZMQ_HEADER_SIZE + csp_buffer_data_size();
+
+	const int datalen = zmq_recv(subscriber, csp_zmqhub_frame(packet), max_size, flags);
+	if (datalen < 0) {
+		return -1;
+	}
+
+	if ((size_t) datalen < CSP_ZMQ_HEADER_SIZE) {
+		csp_log_warn("RX %s: Too short datalen: %u - expected min %u bytes", drv->iface.name, datalen, (unsigned int) CSP_ZMQ_HEADER_SIZE);
+		return 0;
+	}
+
+	if ((size_t) datalen > max_size) {
+		/* Truncated by zmq_recv() */
+		csp_log_warn("RX %s: Too long datalen: %u - expected max %u bytes", drv->iface.name, datalen, (unsigned int) max_size);
+		drv->iface.rx_error++;
+		return 0;
+	}
+
+	packet->length = datalen - CSP_ZMQ_HEADER_SIZE;
+	return 1;
+}
+
+CSP_DEFINE_TASK(csp_zmqhub_task) {
+
+	zmq_rx_socket_t * rx = param;
+	zmq_driver_t * drv = rx->drv;
+
+	/* Wait until all Rx threads are created. On a failed start, the driver is freed once this thread has posted rx_stopped */
+	csp_bin_sem_wait(&drv->rx_start, CSP_MAX_TIMEOUT);
+	if (drv->rx_run == false) {
+		csp_bin_sem_post(&drv->rx_stopped);
+		return CSP_TASK_RETURN;
+	}
+	/* Release the next thread */
+	csp_bin_sem_post(&drv->rx_start);
+
+	csp_packet_t * burst[drv->rx_burst];
+	unsigned int count = 0;
+	unsigned int allocated = 0;
+
+	while(1) {
+
+		/* Wait for the first message, then receive until the socket is empty or the burst is full */
+		int flags = 0;
+		while (count < drv->rx_burst) {
+
+			if (allocated == count) {
+				burst[count] = csp_buffer_get(0); // CSP only supports one size
+				if (burst[count] == NULL) {
+					/* Receive and drop the message, so the socket is still drained */
+					uint8_t discard;
+					const int datalen = zmq_recv(rx->subscriber, &discard, sizeof(discard), flags);
+					if (datalen < 0) {
+						break;
+					}
+					csp_log_warn("RX %s: Failed to get csp_buffer(%u)", drv->iface.name, datalen);
+					drv->iface.drop++;
+					flags = ZMQ_DONTWAIT;
+					continue;
+				}
+				allocated++;
+			}
+
+			// The buffer is reused until a valid message is received
+			const int res = csp_zmqhub_recv(drv, rx->subscriber, burst[count], flags);
+			if (res < 0) {
+				if (zmq_errno() != EAGAIN) {
+					csp_log_error("RX %s: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+				}
+				break;
+			}
+			count += res;
+			flags = ZMQ_DONTWAIT;
+		}
+
+		for (unsigned int i = 0; i < count; i++) {
+			csp_qfifo_write(burst[i], &drv->iface, NULL);
+		}
+		/* An unused buffer is kept for the next burst */
+		if (allocated > count) {
+			burst[0] = burst[count];
+		}
+		allocated -= count;
+		count = 0;
+	}
+
+	return CSP_TASK_RETURN;
+}
+
+/**
+   zmqproxy running in this process.
+*/
+typedef struct {
+	void * frontend;
+	void * backend;
+	csp_thread_handle_t thread;
+} zmq_proxy_t;
+
+/** ZMQ context for in-process endpoints */
+static void * csp_zmqhub_inproc_context;
+static pthread_once_t csp_zmqhub_inproc_once = PTHREAD_ONCE_INIT;
+
+static void csp_zmqhub_inproc_init(void) {
+	csp_zmqhub_inproc_context = zmq_ctx_new();
+}
+
+static inline bool csp_zmqhub_is_inproc(const char * endpoint) {
+	return (strncmp(endpoint, CSP_ZMQ_INPROC, strlen(CSP_ZMQ_INPROC)) == 0);
+}
+
+/**
+   Get ZMQ context for the endpoints: the shared in-process context if any of them is inproc://, otherwise a new context.
+*/
+static void * csp_zmqhub_context(const char * endpoint1, const char * endpoint2) {
+
+	if (csp_zmqhub_is_inproc(endpoint1) || csp_zmqhub_is_inproc(endpoint2)) {
+		pthread_once(&csp_zmqhub_inproc_once, csp_zmqhub_inproc_init);
+		return csp_zmqhub_inproc_context;
+	}
+
+	return zmq_ctx_new();
+}
+
+static CSP_DEFINE_TASK(csp_zmqhub_proxy_task) {
+
+	zmq_proxy_t * proxy = param;
+
+	/* Only returns when the context is terminated */
+	zmq_proxy(proxy->frontend, proxy->backend, NULL);
+	csp_log_error("ZMQPROXY: %s", zmq_strerror(zmq_errno()));
+
+	return CSP_TASK_RETURN;
+}
+
+/**
+   Close sockets and free proxy, on failed start.
+*/
+static void csp_zmqhub_proxy_free(zmq_proxy_t * proxy, void * context) {
+
+	if (proxy->frontend) {
+		zmq_close(proxy->frontend);
+	}
+	if (proxy->backend) {
+		zmq_close(proxy->backend);
+	}
+	if (context != csp_zmqhub_inproc_context) {
+		zmq_ctx_term(context);
+	}
+	csp_free(proxy);
+}
+
+int csp_zmqhub_proxy_start(const char * subscribe_endpoint, const char * publish_endpoint) {
+
+	zmq_proxy_t * proxy = csp_calloc(1, sizeof(*proxy));
+	if (proxy == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	void * context = csp_zmqhub_context(subscribe_endpoint, publish_endpoint);
+	if (context == NULL) {
+		csp_log_error("INIT ZMQPROXY: failed to create ZMQ context: %s", zmq_strerror(zmq_errno()));
+		csp_free(proxy);
+		return CSP_ERR_NOMEM;
+	}
+
+	csp_log_info("INIT ZMQPROXY: sub: [%s], pub: [%s]", subscribe_endpoint, publish_endpoint);
+
+	/* Subscribe (clients publish to this), subscriptions are forwarded to the clients */
+	proxy->frontend = zmq_socket(context, ZMQ_XSUB);
+	if ((proxy->frontend == NULL) || (zmq_bind(proxy->frontend, subscribe_endpoint) != 0)) {
+		csp_log_error("INIT ZMQPROXY: failed to bind sub [%s]: %s", subscribe_endpoint, zmq_strerror(zmq_errno()));
+		csp_zmqhub_proxy_free(proxy, context);
+		return CSP_ERR_DRIVER;
+	}
+
+	/* Publish (clients subscribe to this) */
+	proxy->backend = zmq_socket(context, ZMQ_XPUB);
+	if ((proxy->backend == NULL) || (zmq_bind(proxy->backend, publish_endpoint) != 0)) {
+		csp_log_error("INIT ZMQPROXY: failed to bind pub [%s]: %s", publish_endpoint, zmq_strerror(zmq_errno()));
+		csp_zmqhub_proxy_free(proxy, context);
+		return CSP_ERR_DRIVER;
+	}
+
+	if (csp_thread_create(csp_zmqhub_proxy_task, "ZMQPROXY", 20000, proxy, 0, &proxy->thread) != 0) {
+		csp_log_error("INIT ZMQPROXY: failed to start thread");
+		csp_zmqhub_proxy_free(proxy, context);
+		return CSP_ERR_NOMEM;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_zmqhub_make_endpoint(const char * host, uint16_t port, char * buf, size_t buf_size) {
+	int res;
+	if (strcmp(host, CSP_ZMQHUB_INPROC_HOST) == 0) {
+		res = snprintf(buf, buf_size, CSP_ZMQ_INPROC "zmqproxy-%u", port);
+	} else {
+		res = snprintf(buf, buf_size, "tcp://%s:%u", host, port);
+	}
+	if ((res < 0) || (res >= (int)buf_size)) {
+		buf[0] = 0;
+		return CSP_ERR_NOMEM;
+	}
+	return CSP_ERR_NONE;
+}
+
+int csp_zmqhub_init(uint8_t addr, const char * host, uint32_t flags, csp_iface_t ** return_interface) {
+
+	char pub[100];
+	csp_zmqhub_make_endpoint(host, CSP_ZMQPROXY_SUBSCRIBE_PORT, pub, sizeof(pub));
+
+	char sub[100];
+	csp_zmqhub_make_endpoint(host, CSP_ZMQPROXY_PUBLISH_PORT, sub, sizeof(sub));
+
+	return csp_zmqhub_init_w_endpoints(addr, pub, sub, flags, return_interface);
+}
+
+int csp_zmqhub_init_w_endpoints(uint8_t addr, const char * publisher_endpoint, const char * subscriber_endpoint, uint32_t flags, csp_iface_t ** return_interface) {
+
+	uint8_t * rxfilter = NULL;
+	unsigned int rxfilter_count = 0;
+
+	if (addr != CSP_NO_VIA_ADDRESS) { // != 255
+		rxfilter = &addr;
+		rxfilter_count = 1;
+	}
+
+	return csp_zmqhub_init_w_name_endpoints_rxfilter(NULL, rxfilter, rxfilter_count, publisher_endpoint, subscriber_endpoint, flags, return_interface);
+}
+
+int csp_zmqhub_init_w_name_endpoints_rxfilter(const char * ifname, const uint8_t rxfilter[], unsigned int rxfilter_count, const char * publish_endpoint, const char * subscribe_endpoint, uint32_t flags, csp_iface_t ** return_interface) {
+
+	const csp_zmqhub_conf_t conf = {
+		.ifname = ifname,
+		.rx_filter = rxfilter,
+		.rx_filter_count = rxfilter_count,
+		.publish_endpoint = publish_endpoint,
+		.subscribe_endpoint = subscribe_endpoint,
+		.flags = flags,
+	};
+	return csp_zmqhub_init_w_conf(&conf, return_interface);
+}
+
+/**
+   Close sockets and free driver, on failed init.
+*/
+static void csp_zmqhub_free(zmq_driver_t * drv) {
+
+	if (drv->rx_sockets) {
+		for (unsigned int i = 0; i < drv->rx_socket_count; ++i) {
+			if (drv->rx_sockets[i].subscriber) {
+				zmq_close(drv->rx_sockets[i].subscriber);
+			}
+		}
+		csp_free(drv->rx_sockets);
+	}
+	if (drv->publisher) {
+		zmq_close(drv->publisher);
+	}
+	if (drv->context && (drv->context != csp_zmqhub_inproc_context)) {
+		zmq_ctx_term(drv->context);
+	}
+	csp_free(drv);
+}
+
+int csp_zmqhub_init_w_conf(const csp_zmqhub_conf_t * conf, csp_iface_t ** return_interface) {
+
+	zmq_driver_t * drv = csp_calloc(1, sizeof(*drv));
+	if (drv == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	const char * ifname = conf->ifname ? conf->ifname : CSP_ZMQHUB_IF_NAME;
+	/* Rx filters become subscriptions on the first byte (address/via). Duplicates are removed, as ZMQ would otherwise keep
+	   (and forward to the proxy) one subscription per filter */
+	uint8_t rxfilter[CSP_ZMQ_ADDRESSES];
+	unsigned int rxfilter_count = 0;
+	if (conf->rx_filter) {
+		uint8_t subscribed[CSP_ZMQ_ADDRESSES] = {0};
+		for (unsigned int i = 0; i < conf->rx_filter_count; ++i) {
+			const uint8_t addr = conf->rx_filter[i];
+			if (subscribed[addr] == 0) {
+				subscribed[addr] = 1;
+				rxfilter[rxfilter_count++] = addr;
+			}
+		}
+	}
+
+	/* Subscriptions are divided between the sockets, a socket without subscriptions would never receive anything */
+	const unsigned int subscriptions = rxfilter_count ? rxfilter_count : CSP_ZMQ_ADDRESSES;
+	unsigned int rx_socket_count = conf->rx_sockets ? conf->rx_sockets : 1;
+	if (rx_socket_count > subscriptions) {
+		rx_socket_count = subscriptions;
+	}
+	drv->rx_burst = conf->rx_burst ? conf->rx_burst : CSP_ZMQHUB_RX_BURST;
+
+	const csp_conf_t * csp_conf = csp_get_conf();
+	drv->tx_held_max = (csp_conf && (csp_conf->buffers >= CSP_ZMQ_TX_BUFFER_SHARE)) ? (csp_conf->buffers / CSP_ZMQ_TX_BUFFER_SHARE) : 1;
+
+	strncpy(drv->name, ifname, sizeof(drv->name) - 1);
+	drv->iface.name = drv->name;
+	drv->iface.driver_data = drv;
+	drv->iface.nexthop = csp_zmqhub_tx;
+	drv->iface.mtu = CSP_ZMQ_MTU; // there is actually no 'max' MTU on ZMQ, but assuming the other end is based on the same code
+
+	drv->context = csp_zmqhub_context(conf->publish_endpoint, conf->subscribe_endpoint);
+	if (drv->context == NULL) {
+		csp_log_error("INIT %s: failed to create ZMQ context: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+		csp_free(drv);
+		return CSP_ERR_NOMEM;
+	}
+
+	/* The shared in-process context may already be in use, and inproc:// doesn't use I/O threads */
+	if (conf->io_threads && (drv->context != csp_zmqhub_inproc_context)) {
+		if (zmq_ctx_set(drv->context, ZMQ_IO_THREADS, conf->io_threads) != 0) {
+			csp_log_error("INIT %s: failed to set %u I/O threads: %s", drv->iface.name, conf->io_threads, zmq_strerror(zmq_errno()));
+			csp_zmqhub_free(drv);
+			return CSP_ERR_INVAL;
+		}
+	}
+
+	csp_log_info("INIT %s: pub(tx): [%s], sub(rx): [%s], rx filters: %u, rx sockets: %u", drv->iface.name, conf->publish_endpoint, conf->subscribe_endpoint, rxfilter_count, rx_socket_count);
+
+	/* Publisher (TX) */
+	drv->publisher = zmq_socket(drv->context, ZMQ_PUB);
+	if (drv->publisher == NULL) {
+		csp_log_error("INIT %s: failed to create publish socket: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+		csp_zmqhub_free(drv);
+		return CSP_ERR_DRIVER;
+	}
+
+	/* Subscribers (RX) */
+	drv->rx_sockets = csp_calloc(rx_socket_count, sizeof(*drv->rx_sockets));
+	if (drv->rx_sockets == NULL) {
+		csp_zmqhub_free(drv);
+		return CSP_ERR_NOMEM;
+	}
+	drv->rx_socket_count = rx_socket_count;
+	for (unsigned int i = 0; i < drv->rx_socket_count; ++i) {
+		drv->rx_sockets[i].drv = drv;
+		drv->rx_sockets[i].subscriber = zmq_socket(drv->context, ZMQ_SUB);
+		if (drv->rx_sockets[i].subscriber == NULL) {
+			csp_log_error("INIT %s: failed to create subscribe socket: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+			csp_zmqhub_free(drv);
+			return CSP_ERR_DRIVER;
+		}
+	}
+
+	int res = 0;
+	if (rxfilter_count) {
+		// subscribe to all 'rx_filters' -> subscribe to all packets, where the first byte (address/via) matches a rx_filter
+		for (unsigned int i = 0; (i < rxfilter_count) && (res == 0); ++i) {
+			res = zmq_setsockopt(drv->rx_sockets[i % drv->rx_socket_count].subscriber, ZMQ_SUBSCRIBE, &rxfilter[i], 1);
+		}
+	} else if (drv->rx_socket_count == 1) {
+		// subscribe to all packets - no filter
+		res = zmq_setsockopt(drv->rx_sockets[0].subscriber, ZMQ_SUBSCRIBE, NULL, 0);
+	} else {
+		// subscribe to all packets, divided between the sockets by the first byte (address/via)
+		for (unsigned int addr = 0; (addr < CSP_ZMQ_ADDRESSES) && (res == 0); ++addr) {
+			const uint8_t prefix = addr;
+			res = zmq_setsockopt(drv->rx_sockets[addr % drv->rx_socket_count].subscriber, ZMQ_SUBSCRIBE, &prefix, 1);
+		}
+	}
+	if (res != 0) {
+		csp_log_error("INIT %s: failed to subscribe: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+		csp_zmqhub_free(drv);
+		return CSP_ERR_DRIVER;
+	}
+
+	/* Connect to server */
+	res = zmq_connect(drv->publisher, conf->publish_endpoint);
+	for (unsigned int i = 0; (i < drv->rx_socket_count) && (res == 0); ++i) {
+		res = zmq_connect(drv->rx_sockets[i].subscriber, conf->subscribe_endpoint);
+	}
+	if (res != 0) {
+		csp_log_error("INIT %s: failed to connect: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+		csp_zmqhub_free(drv);
+		return CSP_ERR_DRIVER;
+	}
+
+	/* ZMQ isn't thread safe, so we add a binary semaphore to wait on for tx */
+	if (csp_bin_sem_create(&drv->tx_wait) != CSP_SEMAPHORE_OK) {
+		csp_zmqhub_free(drv);
+		return CSP_ERR_NOMEM;
+	}
+
+	/* Semaphores are created available - take them, so the Rx threads wait for rx_start until all are created */
+	if (csp_bin_sem_create(&drv->rx_start) != CSP_SEMAPHORE_OK) {
+		csp_bin_sem_remove(&drv->tx_wait);
+		csp_zmqhub_free(drv);
+		return CSP_ERR_NOMEM;
+	}
+	csp_bin_sem_wait(&drv->rx_start, 0);
+	if (csp_bin_sem_create(&drv->rx_stopped) != CSP_SEMAPHORE_OK) {
+		csp_bin_sem_remove(&drv->rx_start);
+		csp_bin_sem_remove(&drv->tx_wait);
+		csp_zmqhub_free(drv);
+		return CSP_ERR_NOMEM;
+	}
+	csp_bin_sem_wait(&drv->rx_stopped, 0);
+
+	/* Create RX threads */
+	unsigned int started = 0;
+	for (; started < drv->rx_socket_count; ++started) {
+		if (csp_thread_create(csp_zmqhub_task, drv->iface.name, 20000, &drv->rx_sockets[started], 0, &drv->rx_sockets[started].rx_thread) != 0) {
+			break;
+		}
+	}
+
+	if (started < drv->rx_socket_count) {
+		csp_log_error("INIT %s: failed to start Rx thread %u", drv->iface.name, started);
+		/* Release the created threads one at a time, and wait for each to exit without using the driver */
+		for (unsigned int i = 0; i < started; ++i) {
+			csp_bin_sem_post(&drv->rx_start);
+			csp_bin_sem_wait(&drv->rx_stopped, CSP_MAX_TIMEOUT);
+		}
+		csp_bin_sem_remove(&drv->rx_stopped);
+		csp_bin_sem_remove(&drv->rx_start);
+		csp_bin_sem_remove(&drv->tx_wait);
+		csp_zmqhub_free(drv);
+		return CSP_ERR_NOMEM;
+	}
+
+	/* Start RX threads, each releases the next */
+	drv->rx_run = true;
+	csp_bin_sem_post(&drv->rx_start);
+
+	/* Register interface */
+	csp_iflist_add(&drv->iface);
+
+	if (return_interface) {
+		*return_interface = &drv->iface;
+	}
+
+	return CSP_ERR_NONE;
+}
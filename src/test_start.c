@@ -28,6 +28,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp/drivers/usart.h"
 #include "csp/drivers/can_socketcan.h"
 #include "csp/interfaces/csp_if_zmqhub.h"
+#include "bench/bench.h"
 
 /* Server port, the port the server listens on for incoming connections from the client. */
 #define MY_SERVER_PORT		10
@@ -154,14 +155,16 @@ int main(int argc, char * argv[]) {
     csp_debug_level_t debug_level = CSP_INFO;
 #if (CSP_HAVE_LIBSOCKETCAN)
     const char * can_device = NULL;
+    bool can_fd = false;
 #endif
     const char * kiss_device = NULL;
 #if (CSP_HAVE_LIBZMQ)
     const char * zmq_device = NULL;
 #endif
     const char * rtable = NULL;
+    const char * bench = NULL;
     int opt;
-    while ((opt = getopt(argc, argv, "a:d:r:c:k:z:tR:h")) != -1) {
+    while ((opt = getopt(argc, argv, "a:d:r:c:fk:z:tR:b:h")) != -1) {
         switch (opt) {
             case 'a':
                 address = atoi(optarg);
@@ -176,6 +179,9 @@ int main(int argc, char * argv[]) {
             case 'c':
                 can_device = optarg;
                 break;
+            case 'f':
+                can_fd = true;
+                break;
 #endif
             case 'k':
                 kiss_device = optarg;
@@ -191,21 +197,49 @@ int main(int argc, char * argv[]) {
             case 'R':
                 rtable = optarg;
                 break;
+            case 'b':
+                bench = optarg;
+                break;
             default:
                 printf("Usage:\n"
                        " -a <address>     local CSP address\n"
                        " -d <debug-level> debug level, 0 - 6\n"
                        " -r <address>     run client against server address\n"
                        " -c <can-device>  add CAN device\n"
+                       " -f               use CAN FD on the CAN device\n"
                        " -k <kiss-device> add KISS device (serial)\n"
                        " -z <zmq-device>  add ZMQ device, e.g. \"localhost\"\n"
                        " -R <rtable>      set routing table\n"
-                       " -t               enable test mode\n");
+                       " -t               enable test mode\n"
+                       " -b <benchmark>   run benchmark and exit: crc32, crc16, hmac, aead, kiss, usart\n");
                 exit(1);
                 break;
         }
     }
 
+    if (bench) {
+        if (strcmp(bench, "crc32") == 0) {
+            exit(bench_crc32());
+        }
+        if (strcmp(bench, "crc16") == 0) {
+            exit(bench_crc16());
+        }
+        if (strcmp(bench, "hmac") == 0) {
+            exit(bench_hmac());
+        }
+        if (strcmp(bench, "aead") == 0) {
+            exit(bench_aead());
+        }
+        if (strcmp(bench, "kiss") == 0) {
+            exit(bench_kiss());
+        }
+        if (strcmp(bench, "usart") == 0) {
+            exit(bench_usart());
+        }
+        printf("Unknown benchmark: %s\n", bench);
+        exit(1);
+    }
+
     /* enable/disable debug levels */
     for (csp_debug_level_t i = 0; i <= CSP_LOCK; ++i) {
         csp_debug_set_level(i, (i <= debug_level) ? true : false);
@@ -244,7 +278,11 @@ int main(int argc, char * argv[]) {
     }
 #if (CSP_HAVE_LIBSOCKETCAN)
     if (can_device) {
-        error = csp_can_socketcan_open_and_add_interface(can_device, CSP_IF_CAN_DEFAULT_NAME, 0, false, &default_iface);
+        if (can_fd) {
+            error = csp_can_socketcan_open_and_add_interface_fd(can_device, CSP_IF_CAN_DEFAULT_NAME, 0, false, &default_iface);
+        } else {
+            error = csp_can_socketcan_open_and_add_interface(can_device, CSP_IF_CAN_DEFAULT_NAME, 0, false, &default_iface);
+        }
         if (error != CSP_ERR_NONE) {
             csp_log_error("failed to add CAN interface [%s], error: %d", can_device, error);
             exit(1);